@@ -0,0 +1,283 @@
+# Copyright 2023 Leo James Peckham (padril)
+
+"""
+Compile-throughput regression gate for `toki.c`.
+
+Generates a deterministic corpus of `.toki` programs (hello-world scale
+up to 100k generated sentences), compiles each through the full `main()`
+path with the external toolchain (`nasm`/`gcc`) stubbed out via PATH,
+and records wall time, peak RSS, output size, and (optionally) syscall
+counts against the stored baselines in `test/perf/baseline.json`.
+
+The gate fails when any metric regresses past its tolerance. Baselines
+are machine-specific; refresh them with `--update` when moving to new
+hardware or after an intentional trade-off.
+"""
+
+
+import argparse
+import json
+import os
+import resource
+import shlex
+import shutil
+import stat
+import subprocess
+import time
+from typing import Any
+
+
+# DEFAULTS
+
+BASELINE_PATH = "./test/perf/baseline.json"
+WORK_PATH = "./test/perf/work"
+
+# (name, sentence count); the generator below is seedless and cycles a
+# fixed set of sentence shapes, so every run produces identical bytes
+CORPUS = [
+    ("hello", 1),
+    ("prints_1k", 1_000),
+    ("prints_20k", 20_000),
+    ("mixed_100k", 100_000),
+]
+
+# metric -> allowed current/baseline ratio; output size is fully
+# deterministic, so it gets almost no slack
+TOLERANCES = {
+    "wall_ms": 1.30,
+    "max_rss_kb": 1.20,
+    "output_bytes": 1.05,
+    "syscalls": 1.25,
+}
+
+NASM_STUB = """#!/bin/sh
+# perf.py toolchain stub: capture the assembly fed over the pipe as the
+# "object file" so its size is measurable, and succeed
+out=
+next=0
+for arg in "$@"; do
+    if [ "$next" = 1 ]; then out="$arg"; next=0; fi
+    if [ "$arg" = "-o" ]; then next=1; fi
+done
+if [ -n "$out" ]; then cat > "$out"; else cat > /dev/null; fi
+exit 0
+"""
+
+GCC_STUB = """#!/bin/sh
+# perf.py toolchain stub: pretend to link
+exit 0
+"""
+
+
+def get_flags() -> "dict[str, Any]":
+    """
+    Returns the flags necessary for program logic, retrieved from command line
+    arguments.
+    """
+    parser = argparse.ArgumentParser(
+        prog="toki.c Performance Gate",
+        description="Compiles a generated corpus and compares throughput "
+                    "metrics against stored baselines.")
+
+    parser.add_argument("-m", "--maketoki",
+                        help="Make `toki.c` before running if true, or use "
+                             "the existing binary if false",
+                        action=argparse.BooleanOptionalAction)
+    parser.add_argument("-r", "--repeat",
+                        help="Runs per corpus entry; the best wall time is "
+                             "recorded to damp scheduler noise",
+                        type=int,
+                        default=3)
+    parser.add_argument("-s", "--syscalls",
+                        help="Also record syscall counts via strace, when "
+                             "strace is available",
+                        action=argparse.BooleanOptionalAction)
+    parser.add_argument("-u", "--update",
+                        help="Rewrite the baseline file with this run's "
+                             "numbers instead of gating against it",
+                        action=argparse.BooleanOptionalAction)
+    parser.add_argument("-b", "--baseline",
+                        help="Path to the baseline JSON file",
+                        metavar="PATH",
+                        default=BASELINE_PATH)
+
+    return parser.parse_args().__dict__
+
+
+def make_toki():
+    if not os.path.exists("./toki.c"):
+        raise Exception("Cannot find `toki.c`, try compiling yourself")
+    if not os.path.exists("./makefile"):
+        raise Exception("Cannot find `makefile`, try compiling yourself")
+
+    subprocess.run(shlex.split("make toki"), check=True)
+
+
+def find_toki() -> str:
+    for binary in ["./toki", "./toki.exe"]:
+        if os.path.exists(binary):
+            return binary
+    raise Exception("Cannot find the toki binary, try `--maketoki`")
+
+
+def generate_corpus() -> "list[tuple[str, str]]":
+    """
+    Writes the corpus files under the work directory and returns
+    (name, path) pairs. Generation is deterministic: the same shapes in
+    the same order every run, so output sizes are comparable over time.
+    """
+    os.makedirs(WORK_PATH, exist_ok=True)
+    entries = []
+    for name, sentences in CORPUS:
+        path = os.path.join(WORK_PATH, name + ".toki")
+        with open(path, "w") as f:
+            for n in range(sentences):
+                shape = n % 4
+                if shape == 0:
+                    f.write(f'o sitelen e "line {n} of {name}".\n')
+                elif shape == 1:
+                    f.write(f'o sitelen e {n * 7 % 10000}.\n')
+                elif shape == 2:
+                    # each variable is defined exactly once and read by
+                    # the following sentence
+                    f.write(f'var{n} li kama e {n}.\n')
+                else:
+                    f.write(f'o sitelen e var{n - 1}.\n')
+        entries.append((name, path))
+    return entries
+
+
+def write_stubs() -> str:
+    """
+    Creates the stub `nasm` and `gcc` in a bin directory to prepend to
+    PATH, so `make()` runs its full pipe/system path without the real
+    toolchain.
+    """
+    bin_path = os.path.join(WORK_PATH, "bin")
+    os.makedirs(bin_path, exist_ok=True)
+    for tool, body in [("nasm", NASM_STUB), ("gcc", GCC_STUB)]:
+        path = os.path.join(bin_path, tool)
+        with open(path, "w") as f:
+            f.write(body)
+        os.chmod(path, os.stat(path).st_mode |
+                 stat.S_IXUSR | stat.S_IXGRP | stat.S_IXOTH)
+    return os.path.abspath(bin_path)
+
+
+def count_syscalls(command: "list[str]", env: "dict[str, str]") -> int:
+    trace_path = os.path.join(WORK_PATH, "strace.txt")
+    subprocess.run(["strace", "-f", "-c", "-o", trace_path] + command,
+                   env=env, capture_output=True)
+    with open(trace_path) as f:
+        # the summary's last line is "100.00 <seconds> ... <calls> total"
+        total = f.read().strip().split("\n")[-1].split()
+    os.remove(trace_path)
+    return int(total[3])
+
+
+def measure(toki: str, source: str, flags: "dict[str, Any]",
+            bin_path: str) -> "dict[str, Any]":
+    """
+    Compiles `source` through the stubbed toolchain `--repeat` times and
+    returns the best metrics observed.
+    """
+    out_base = os.path.join(WORK_PATH, "out")
+    command = [toki, source, out_base]
+    env = dict(os.environ)
+    env["PATH"] = bin_path + os.pathsep + env.get("PATH", "")
+
+    best = None
+    for _ in range(max(1, flags["repeat"])):
+        for leftover in [".obj", ".asm", ".tokicache"]:
+            if os.path.exists(out_base + leftover):
+                os.remove(out_base + leftover)
+        if os.path.exists(source + ".tokens"):
+            os.remove(source + ".tokens")
+
+        before = resource.getrusage(resource.RUSAGE_CHILDREN)
+        start = time.monotonic()
+        proc = subprocess.run(command, env=env, capture_output=True)
+        wall_ms = (time.monotonic() - start) * 1e3
+        after = resource.getrusage(resource.RUSAGE_CHILDREN)
+
+        if proc.returncode != 0:
+            raise Exception(f"Compiling `{source}` failed "
+                            f"(code {proc.returncode}):\n"
+                            f"{proc.stderr.decode()}")
+
+        metrics = {
+            "wall_ms": round(wall_ms, 2),
+            # ru_maxrss is a high-water mark over all children; the
+            # first repeat therefore reports the truest number
+            "max_rss_kb": max(after.ru_maxrss, before.ru_maxrss),
+            "output_bytes": os.path.getsize(out_base + ".obj"),
+        }
+        if best is None or metrics["wall_ms"] < best["wall_ms"]:
+            best = {**metrics, "max_rss_kb": best["max_rss_kb"]
+                    if best else metrics["max_rss_kb"]}
+
+    if flags["syscalls"] and shutil.which("strace"):
+        best["syscalls"] = count_syscalls(command, env)
+
+    return best
+
+
+def gate(name: str, current: "dict[str, Any]",
+         baseline: "dict[str, Any]") -> "list[str]":
+    failures = []
+    for metric, tolerance in TOLERANCES.items():
+        if metric not in current or metric not in baseline:
+            continue
+        allowed = baseline[metric] * tolerance
+        if current[metric] > allowed:
+            failures.append(
+                f"FAILURE: {name} {metric}: {current[metric]} > "
+                f"{baseline[metric]} * {tolerance}")
+    return failures
+
+
+def main():
+    flags = get_flags()
+
+    if flags["maketoki"]:
+        make_toki()
+    toki = find_toki()
+
+    entries = generate_corpus()
+    bin_path = write_stubs()
+
+    baselines = {}
+    if os.path.exists(flags["baseline"]):
+        with open(flags["baseline"]) as f:
+            baselines = json.load(f)
+
+    results = {}
+    failures = []
+    for name, path in entries:
+        results[name] = measure(toki, path, flags, bin_path)
+        line = "  ".join(f"{metric}={value}"
+                         for metric, value in results[name].items())
+        print(f"{name}: {line}")
+        if not flags["update"]:
+            if name in baselines:
+                failures += gate(name, results[name], baselines[name])
+            else:
+                print(f"WARNING: no baseline for `{name}`, "
+                      "run with `--update`")
+
+    if flags["update"]:
+        os.makedirs(os.path.dirname(flags["baseline"]), exist_ok=True)
+        with open(flags["baseline"], "w") as f:
+            json.dump(results, f, indent=4)
+            f.write("\n")
+        print(f"BASELINES UPDATED: {flags['baseline']}")
+        return
+
+    if failures:
+        print("\n".join(failures))
+        raise SystemExit(1)
+    print("PERF GATE PASSED")
+
+
+if __name__ == "__main__":
+    main()
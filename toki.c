@@ -5,9 +5,30 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef __SSE2__
+// Used by the block character-classification skips in tokenize()
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+// Used by the memory-mapped input path in read_source() and the forked
+// workers in batch_main()
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 // FLAG DEFINITIONS
 
@@ -16,26 +37,522 @@
 #define DEFAULT_INPUT_FILENAME \
     "./test/end_to_end/hello_world/hello_world_test.toki"
 #define DEFAULT_OUTPUT_FILENAME "a"
+#define DEFAULT_SOCKET_FILENAME "toki.sock"
 
 /* When set to 1, will delete generated .asm and .obj files. Turn off if
  * you want to keep the files (e.g. to debug ASM code)
  */
 #define DELETE_INTERMEDIATE 0
 
-// GRAMMAR DEFINITIONS
+/* When set to 1, the generated assembly is piped straight into nasm and
+ * never round-trips through a `.asm` file on disk. Turn off if you always
+ * want the `.asm` file (e.g. to debug ASM code); if nasm cannot be run
+ * through the pipe, `make()` falls back to the file path on its own.
+ */
+#define ASSEMBLE_VIA_PIPE 1
+
+#ifdef _WIN32
+// The pipe to nasm uses the underscore-prefixed CRT names on Windows
+#define popen _popen
+#define pclose _pclose
+#endif
+
+
+// PROFILING
+
+/* Lightweight pipeline instrumentation behind `--profile`. The counters
+ * are plain increments on paths that already do heavier work (an arena
+ * allocation, an external toolchain call), so they stay compiled in
+ * (the per-allocation pair is thread-local, see below);
+ * the flag only controls whether the summary is printed. The report is
+ * one machine-readable key=value line on stderr per compilation, so a
+ * slow batch can be attributed to lexing, parsing, codegen or the
+ * nasm/gcc calls in `make()` without rebuilding the compiler.
+ */
+typedef struct Profile
+{
+    bool enabled;
+    size_t arena_allocs;
+    size_t arena_bytes;
+    size_t tokens;
+    size_t sentences;
+    double scan_wall;
+    double parse_wall;
+    double codegen_wall;
+    double assemble_wall;  // inside the popen/system calls of make()
+    double total_wall;
+    double total_cpu;
+} Profile;
+
+static Profile profile = {false, 0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+// The arena counters are bumped on every allocation, which the codegen
+// workers do concurrently; each thread counts into its own pair and
+// folds them into `profile` when it is done (workers at exit, the main
+// thread when reporting), so the hot increment stays a plain add.
+#ifdef _WIN32
+static size_t arena_allocs = 0;
+static size_t arena_bytes = 0;
+#else
+static __thread size_t arena_allocs = 0;
+static __thread size_t arena_bytes = 0;
+#endif
+
+#ifndef _WIN32
+// Workers fold their counters concurrently at exit
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Folds the calling thread's arena counters into the shared profile and
+ * rezeroes them.
+ */
+static void profile_adopt_arena(void)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&profile_mutex);
+#endif
+    profile.arena_allocs += arena_allocs;
+    profile.arena_bytes += arena_bytes;
+#ifndef _WIN32
+    pthread_mutex_unlock(&profile_mutex);
+#endif
+    arena_allocs = 0;
+    arena_bytes = 0;
+}
+
+static double profile_wall(void)
+{
+#ifdef _WIN32
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+static double profile_cpu(void)
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+/* Rezeroes the per-compilation counters (the resident modes compile many
+ * files per process) without touching `enabled`.
+ */
+void profile_begin(void)
+{
+    bool enabled = profile.enabled;
+    memset(&profile, 0, sizeof(profile));
+    profile.enabled = enabled;
+}
+
+void profile_report(void)
+{
+    profile_adopt_arena();
+    fprintf(
+        stderr,
+        "profile: tokens=%zu sentences=%zu arena_allocs=%zu "
+        "arena_bytes=%zu scan_ms=%.3f parse_ms=%.3f codegen_ms=%.3f "
+        "assemble_ms=%.3f total_ms=%.3f cpu_ms=%.3f\n",
+        profile.tokens,
+        profile.sentences,
+        profile.arena_allocs,
+        profile.arena_bytes,
+        profile.scan_wall * 1e3,
+        profile.parse_wall * 1e3,
+        profile.codegen_wall * 1e3,
+        profile.assemble_wall * 1e3,
+        profile.total_wall * 1e3,
+        profile.total_cpu * 1e3);
+}
+
+// MEMORY
+
+/* Bump arena that owns every allocation made by the compilation pipeline.
+ * Nearly everything the pipeline allocates (token values, phrase buffers,
+ * ASM lines) lives exactly as long as one compilation, so instead of
+ * hitting `malloc` per object (and leaking most of them), `arena_alloc()`
+ * bumps a pointer inside a large block, chaining in a new block when the
+ * current one fills up. `arena_reset()` frees every block at once when the
+ * compilation is done.
+ */
+#define ARENA_BLOCK_SIZE (1 << 16)
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *prev;
+    size_t used;
+    size_t capacity;
+    // block memory follows the header
+} ArenaBlock;
+
+// Thread-local, so the parallel codegen workers can bump-allocate
+// without contending on (or corrupting) each other's blocks; see
+// arena_detach/arena_adopt for how their memory outlives the worker.
+#ifdef _WIN32
+static ArenaBlock *arena = NULL;
+#else
+static __thread ArenaBlock *arena = NULL;
+#endif
+
+void *arena_alloc(size_t size)
+{
+    // Keep every allocation 8-aligned, which is enough for all the
+    // pipeline's types
+    size = (size + 7) & ~(size_t) 7;
+
+    ++arena_allocs;
+    arena_bytes += size;
+
+    if ((arena == NULL) || (arena->used + size > arena->capacity))
+    {
+        size_t capacity = ARENA_BLOCK_SIZE;
+        if (size > capacity)
+        {
+            capacity = size;
+        }
+        ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+        block->prev = arena;
+        block->used = 0;
+        block->capacity = capacity;
+        arena = block;
+    }
+
+    void *p = (char *) (arena + 1) + arena->used;
+    arena->used += size;
+    return p;
+}
+
+/* Hands the calling thread's arena chain to the caller and leaves the
+ * thread with an empty arena. A codegen worker detaches its chain just
+ * before exiting and the main thread adopts it, so lines allocated on a
+ * worker stay valid until the main thread's next `arena_reset()`.
+ */
+ArenaBlock *arena_detach(void)
+{
+    ArenaBlock *chain = arena;
+    arena = NULL;
+    return chain;
+}
+
+void arena_adopt(ArenaBlock *chain)
+{
+    if (chain == NULL)
+    {
+        return;
+    }
+    ArenaBlock *last = chain;
+    while (last->prev != NULL)
+    {
+        last = last->prev;
+    }
+    last->prev = arena;
+    arena = chain;
+}
+
+void arena_reset(void)
+{
+    // Keep the newest block warm instead of freeing everything: the
+    // resident modes (--daemon, --batch) compile many files per process,
+    // and reusing one block spares a malloc round trip per compilation.
+    ArenaBlock *keep = arena;
+    if (keep != NULL)
+    {
+        arena = keep->prev;
+        keep->prev = NULL;
+        keep->used = 0;
+    }
+    while (arena != NULL)
+    {
+        ArenaBlock *prev = arena->prev;
+        free(arena);
+        arena = prev;
+    }
+    arena = keep;
+}
+
+/* Generic capacity-doubling append for the pipeline's list structs
+ * (`TokenList`, `SentenceList`, `PrepPhraseList`, `SectionData`,
+ * `SectionText`). Growth is geometric, so appending is amortized O(1) and
+ * memory scales with the actual input instead of a hard-coded guess.
+ * Doubling allocates the new block from the arena and copies; the old
+ * block is simply abandoned, which is fine because the arena reclaims
+ * everything wholesale in `arena_reset()`.
+ */
+#define LIST_APPEND(list, size, capacity, type, item)                      \
+    do                                                                     \
+    {                                                                      \
+        if ((size) == (capacity))                                          \
+        {                                                                  \
+            size_t list_append_cap = (capacity) ? (capacity) * 2 : 8;      \
+            type *list_append_new =                                        \
+                arena_alloc(list_append_cap * sizeof(type));               \
+            memcpy(list_append_new, (list), (size) * sizeof(type));        \
+            (list) = list_append_new;                                      \
+            (capacity) = list_append_cap;                                  \
+        }                                                                  \
+        (list)[(size)++] = (item);                                         \
+    } while (0)
+
+/* Small open-addressed set of nonzero uint32 values, arena-backed. Used
+ * wherever the pipeline needs "have I seen this id before" in O(1) --
+ * e.g. which string-literal labels are already defined in the data
+ * section. Zero is the empty-slot sentinel, so callers must never insert
+ * zero.
+ */
+typedef struct U32Set
+{
+    uint32_t *slots;
+    size_t used;
+    size_t slot_count;
+} U32Set;
+
+#define U32SET_DEFAULT ((U32Set) {.slots = NULL, .used = 0, .slot_count = 0})
+
+static void u32set_grow(U32Set *set)
+{
+    size_t slot_count = set->slot_count ? set->slot_count * 2 : 64;
+    uint32_t *slots = arena_alloc(slot_count * sizeof(uint32_t));
+    memset(slots, 0, slot_count * sizeof(uint32_t));
+    for (size_t i = 0; i < set->slot_count; ++i)
+    {
+        if (set->slots[i] != 0)
+        {
+            size_t j = set->slots[i] % slot_count;
+            while (slots[j] != 0)
+            {
+                j = (j + 1) % slot_count;
+            }
+            slots[j] = set->slots[i];
+        }
+    }
+    set->slots = slots;
+    set->slot_count = slot_count;
+}
+
+/* Inserts `value` (which must be nonzero); returns false if it was
+ * already present.
+ */
+bool u32set_add(U32Set *set, uint32_t value)
+{
+    if ((set->slot_count == 0) || (set->used * 3 >= set->slot_count * 2))
+    {
+        u32set_grow(set);
+    }
+
+    size_t i = value % set->slot_count;
+    while (set->slots[i] != 0)
+    {
+        if (set->slots[i] == value)
+        {
+            return false;
+        }
+        i = (i + 1) % set->slot_count;
+    }
+    set->slots[i] = value;
+    ++set->used;
+    return true;
+}
+
+
+// DIAGNOSTICS
+
+/* Batched diagnostics: every stage records errors here instead of
+ * exiting on the first one. The scanner skips the offending byte, the
+ * parser resynchronizes at the next period, and codegen drops the bad
+ * sentence, so one pass over a file reports every error in it. The
+ * driver flushes the batch when the compilation is done and fails the
+ * compile (skipping the toolchain and the fragment-cache write) if
+ * anything was recorded.
+ */
+typedef struct Diagnostic
+{
+    int line;  // 1-based; 0 when the reporting stage has no position
+    int col;
+    const char *message;
+} Diagnostic;
+
+typedef struct DiagnosticList
+{
+    Diagnostic *list;
+    size_t size;
+    size_t capacity;
+} DiagnosticList;
+
+static DiagnosticList diagnostics = {NULL, 0, 0};
+
+#ifndef _WIN32
+// Codegen workers can report concurrently
+static pthread_mutex_t diagnostics_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void diag_report(int line, int col, const char *fmt, ...)
+{
+    va_list args;
+    va_list argscopy;
+    va_start(args, fmt);
+    va_copy(argscopy, args);
+
+    size_t formatted_length = (size_t) vsnprintf(NULL, 0, fmt, args) + 1;
+
+    char *message = arena_alloc(formatted_length * sizeof(char));
+    vsnprintf(message, formatted_length, fmt, argscopy);
+
+    va_end(args);
+    va_end(argscopy);
+
+    Diagnostic d = {.line = line, .col = col, .message = message};
+#ifndef _WIN32
+    pthread_mutex_lock(&diagnostics_mutex);
+#endif
+    LIST_APPEND(diagnostics.list, diagnostics.size, diagnostics.capacity,
+                Diagnostic, d);
+#ifndef _WIN32
+    pthread_mutex_unlock(&diagnostics_mutex);
+#endif
+}
+
+/* Prints every recorded diagnostic, clears the batch and returns how
+ * many there were. Must run before the `arena_reset()` that owns the
+ * messages.
+ */
+size_t diag_flush(void)
+{
+    for (size_t i = 0; i < diagnostics.size; ++i)
+    {
+        Diagnostic d = diagnostics.list[i];
+        if (d.line > 0)
+        {
+            fprintf(stderr, "error: Ln %d, Col %d: %s\n",
+                    d.line, d.col, d.message);
+        }
+        else
+        {
+            fprintf(stderr, "error: %s\n", d.message);
+        }
+    }
+    size_t count = diagnostics.size;
+    diagnostics.list = NULL;
+    diagnostics.size = 0;
+    diagnostics.capacity = 0;
+    return count;
+}
 
-/* Lexemes are raw strings which match a Token's pattern that have yet to be
- * evaluated. Created from input using `scan()`. `LexemeList` is a list of
- * Lexemes that also keeps track of the length, to allow easy passing to
- * functions and iteration. 
+// STRING INTERNING
+
+/* Interns every identifier and string-literal spelling the tokenizer
+ * sees, so each distinct spelling is stored exactly once (in the arena)
+ * and Tokens refer to it by a stable `InternId` index instead of owning
+ * their own heap copy. Generated sources repeat the same identifiers
+ * constantly; with interning a repeat costs a hash probe, not an
+ * allocation, and comparing two interned strings is an integer compare.
+ * Lookup is an FNV-1a hash into an open-addressed slot table that doubles
+ * when it passes two-thirds full.
+ * The table lives in the arena, so `intern_reset()` must accompany every
+ * `arena_reset()`.
  */
-typedef const char * Lexeme;
+typedef uint32_t InternId;
 
-typedef struct LexemeList
+#define INTERN_EMPTY ((InternId) -1)
+
+typedef struct InternTable
 {
-    Lexeme *list;
+    const char **strings;  // InternId -> canonical NUL-terminated string
     size_t size;
-} LexemeList;
+    size_t capacity;
+    InternId *slots;       // open-addressed hash slots
+    size_t slot_count;
+} InternTable;
+
+static InternTable interns = {NULL, 0, 0, NULL, 0};
+
+/* FNV-1a, the pipeline's hash of choice: `fnv1a_update()` folds a byte
+ * range into a running hash, so callers can hash structured data
+ * piecewise.
+ */
+#define FNV1A_SEED 2166136261u
+
+static uint32_t fnv1a_update(uint32_t h, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t intern_hash(const char *text, size_t len)
+{
+    return fnv1a_update(FNV1A_SEED, text, len);
+}
+
+static void intern_grow_slots(void)
+{
+    size_t slot_count = interns.slot_count ? interns.slot_count * 2 : 64;
+    InternId *slots = arena_alloc(slot_count * sizeof(InternId));
+    for (size_t i = 0; i < slot_count; ++i)
+    {
+        slots[i] = INTERN_EMPTY;
+    }
+    for (InternId id = 0; id < interns.size; ++id)
+    {
+        const char *s = interns.strings[id];
+        size_t i = intern_hash(s, strlen(s)) % slot_count;
+        while (slots[i] != INTERN_EMPTY)
+        {
+            i = (i + 1) % slot_count;
+        }
+        slots[i] = id;
+    }
+    interns.slots = slots;
+    interns.slot_count = slot_count;
+}
+
+/* Returns the `InternId` for the first `len` bytes of `text` (which need
+ * not be NUL-terminated), interning them if they have not been seen yet.
+ */
+InternId intern(const char *text, size_t len)
+{
+    if ((interns.slot_count == 0) ||
+        (interns.size * 3 >= interns.slot_count * 2))
+    {
+        intern_grow_slots();
+    }
+
+    size_t i = intern_hash(text, len) % interns.slot_count;
+    while (interns.slots[i] != INTERN_EMPTY)
+    {
+        const char *candidate = interns.strings[interns.slots[i]];
+        if (!strncmp(candidate, text, len) && (candidate[len] == '\0'))
+        {
+            return interns.slots[i];
+        }
+        i = (i + 1) % interns.slot_count;
+    }
+
+    char *copy = arena_alloc(len + 1);
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    LIST_APPEND(interns.strings, interns.size, interns.capacity,
+                const char *, copy);
+    interns.slots[i] = (InternId) (interns.size - 1);
+    return interns.slots[i];
+}
+
+/* Returns the canonical string for an `InternId`.
+ */
+const char *intern_string(InternId id)
+{
+    return interns.strings[id];
+}
+
+void intern_reset(void)
+{
+    interns = (InternTable) {NULL, 0, 0, NULL, 0};
+}
+
+// GRAMMAR DEFINITIONS
 
 /* Keeps track of the language's Keywords as an enum `Keyword` and a list of
  * strings `KEYWORDS` as well as their length in `KEYWORD_COUNT`. Both enum
@@ -114,12 +631,14 @@ typedef long long IntegerLiteralType;  // These use strto methods in the code
 typedef double FloatLiteralType;       // make sure to update those too
 
 /* Tokens are the base unit of the program's grammar. They store a type as
- * a `TokenType`, a value, and a size of that value in bytes. They are
- * created by Lexemes using `evaluate`. `TokenList` is a list of Tokens that
- * also keeps track of the length, to allow easy passing to functions and
+ * a `TokenType` and a value in a tagged union, selected by the type (and,
+ * for literals, by `literal`); every value fits in the Token itself, so no
+ * Token ever points into the heap. They are created directly from the
+ * input using `tokenize()`. `TokenList` is a list of Tokens that also
+ * keeps track of the length, to allow easy passing to functions and
  * iteration.
  * Default/NULL values of `Token` and `TokenList` also exist as
- * `Token_default` and `TokenList_default`, due to the necessity of
+ * `TOKEN_DEFAULT` and `TOKENLIST_DEFAULT`, due to the necessity of
  * initializing Tokens without a value.
  */
 typedef enum TokenType
@@ -135,25 +654,63 @@ typedef enum TokenType
 typedef struct Token
 {
     TokenType type;
-    void *value;
     Literal literal;
+    union
+    {
+        Keyword keyword;             // TOKEN_KEYWORD
+        Separator separator;         // TOKEN_SEPARATOR
+        InternId name;               // TOKEN_IDENTIFIER
+        InternId string;             // LITERAL_STRING
+        IntegerLiteralType integer;  // LITERAL_INTEGER
+        FloatLiteralType floating;   // LITERAL_FLOAT
+    } value;
 } Token;
 
 #define TOKEN_DEFAULT ((Token) {\
-    .type = TOKEN_NULL, .literal = LITERAL_NULL, .value = NULL\
+    .type = TOKEN_NULL, .literal = LITERAL_NULL, .value.integer = 0\
 })
 
 typedef struct TokenList
 {
     Token *list;
     size_t size;
+    size_t capacity;
 } TokenList;
 
 #define TOKENLIST_DEFAULT ((TokenList) {\
     .list = NULL,\
+    .size = 0,\
+    .capacity = 0\
+})
+
+/* Small-size-optimized token list for modifier phrases (adjp/advp). In
+ * real toki pona text nearly every phrase carries zero to two
+ * modifiers, so that many Tokens live inline in the phrase struct
+ * itself -- building and reading a Sentence stays within the struct's
+ * own cache lines -- and only the rare longer phrase spills the
+ * remainder to an arena list.
+ */
+#define MODIFIER_INLINE 2
+
+typedef struct ModifierList
+{
+    Token head[MODIFIER_INLINE];  // the first MODIFIER_INLINE modifiers
+    TokenList spill;              // modifiers beyond MODIFIER_INLINE
+    size_t size;                  // total modifier count
+} ModifierList;
+
+#define MODIFIERLIST_DEFAULT ((ModifierList) {\
+    .head = {TOKEN_DEFAULT, TOKEN_DEFAULT},\
+    .spill = TOKENLIST_DEFAULT,\
     .size = 0\
 })
 
+static inline Token modlist_get(const ModifierList *l, size_t i)
+{
+    return (i < MODIFIER_INLINE) ? l->head[i]
+                                 : l->spill.list[i - MODIFIER_INLINE];
+}
+
 /* The following structs define a DCG for constructing toki's expressions,
  * which due to the emulation of a natural language look more like sentences.
  * The structs only hold information intrinsic to the type of phrase, and do
@@ -174,12 +731,12 @@ typedef struct TokenList
 
 typedef struct NounPhraseWithoutPrep {
     Token noun;
-    TokenList adjp;
+    ModifierList adjp;
 } NounPhraseWithoutPrep;
 
 #define NOUNPHRASEWITHOUTPREP_DEFAULT ((NounPhraseWithoutPrep) {\
     .noun = TOKEN_DEFAULT,\
-    .adjp = TOKENLIST_DEFAULT\
+    .adjp = MODIFIERLIST_DEFAULT\
 })
 
 typedef struct PrepPhrase {
@@ -196,36 +753,38 @@ typedef struct PrepPhrase {
 typedef struct PrepPhraseList {
     PrepPhrase *list;
     size_t size;
+    size_t capacity;
 } PrepPhraseList;
 
 #define PREPPHRASELIST_DEFAULT ((PrepPhraseList) {\
     .list = NULL,\
-    .size = 0\
+    .size = 0,\
+    .capacity = 0\
 })
 
 typedef struct NounPhrase
 {
     Token noun;         // noun
-    TokenList adjp;     // adjective phrase
+    ModifierList adjp;  // adjective phrase
     PrepPhraseList ppl;  // prepositional phrase +
 } NounPhrase;
 
 #define NOUNPHRASE_DEFAULT ((NounPhrase) {\
     .noun = TOKEN_DEFAULT,\
-    .adjp = TOKENLIST_DEFAULT,\
+    .adjp = MODIFIERLIST_DEFAULT,\
     .ppl = PREPPHRASELIST_DEFAULT\
 })
 
 typedef struct VerbPhrase
 {
-    Token verb;       // verb
-    TokenList advp;   // adverb phrase
-    NounPhrase obj;   // object
+    Token verb;        // verb
+    ModifierList advp; // adverb phrase
+    NounPhrase obj;    // object
 } VerbPhrase;
 
 #define VERBPHRASE_DEFAULT ((VerbPhrase) {\
     .verb = TOKEN_DEFAULT,\
-    .advp = TOKENLIST_DEFAULT,\
+    .advp = MODIFIERLIST_DEFAULT,\
     .obj = NOUNPHRASE_DEFAULT\
 })
 
@@ -244,6 +803,7 @@ typedef struct SentenceList
 {
     Sentence *list;
     size_t size;
+    size_t capacity;
 } SentenceList;
 
 /* These structs hold the data that will be included in the write to ASM.
@@ -254,25 +814,55 @@ typedef struct SectionData
 {
     const char **lines;
     size_t size;
-    int literals;
+    size_t capacity;
+    // parallel to `lines`: the literal label a line defines, or 0. Lets
+    // the fragment cache splice lines without re-parsing them.
+    uint32_t *labels;
+    size_t label_size;
+    size_t label_capacity;
+    // literal labels already defined in this output
+    U32Set emitted;
+    // budget mode (see memory_budget): whether this section may stream
+    // its lines to disk, the stream once it has, and the formatted
+    // bytes still held in memory
+    bool spillable;
+    FILE *spill;
+    size_t bytes;
 } SectionData;
 
+#define SECTIONDATA_DEFAULT ((SectionData) {\
+    .lines = NULL, .size = 0, .capacity = 0,\
+    .labels = NULL, .label_size = 0, .label_capacity = 0,\
+    .emitted = U32SET_DEFAULT,\
+    .spillable = false, .spill = NULL, .bytes = 0\
+})
+
 typedef struct SectionText
 {
     const char **lines;
     size_t size;
+    size_t capacity;
+    // budget mode: as in SectionData
+    bool spillable;
+    FILE *spill;
+    size_t bytes;
 } SectionText;
 
+#define SECTIONTEXT_DEFAULT ((SectionText) {\
+    .lines = NULL, .size = 0, .capacity = 0,\
+    .spillable = false, .spill = NULL, .bytes = 0\
+})
+
 // HELPER FUNCTIONS
 
 static inline bool is_keyword(Token t, Keyword kw) {
     return (t.type == TOKEN_KEYWORD) &&
-           (* (Keyword *) t.value == kw);
+           (t.value.keyword == kw);
 }
 
 static inline bool is_seperator(Token t, Separator sp) {
     return (t.type == TOKEN_SEPARATOR) &&
-           (* (Separator *) t.value == sp);
+           (t.value.separator == sp);
 }
 
 static inline bool is_literal(Token t, Literal lt) {
@@ -280,810 +870,3279 @@ static inline bool is_literal(Token t, Literal lt) {
            (t.literal == lt);
 }
 
-// LEXICAL ANALYSIS
 
-/* Begins the process of Lexical Analysis by generating a list of Lexemes
- * from the input string.
- * (https://en.wikipedia.org/wiki/Lexical_analysis)
- * 
- * Matches:
- * TEXT   = [a-zA-Z][a-zA-Z0-9]*
- * NUMBER = [0-9]+(\.[0-9]+)
- * STRING = ".*"
+/* Constant folding over a noun phrase's prepositional chain. The parser
+ * only ever builds chains with `kin` (addition) as the preposition, and
+ * operators evaluate left to right, so a fully-literal chain collapses
+ * to a single literal here at compile time -- the common case in
+ * generated numeric sources. Any float in the chain promotes the
+ * result. Returns false when anything non-literal (or non-numeric)
+ * appears, leaving the chain for the runtime evaluator.
  */
-LexemeList scan(const char *input)
+static bool np_fold(NounPhrase np, Token *out)
 {
-    // Match denotes what the current Lexeme being analyzed could match
-    typedef enum Match
+    if (np.noun.type != TOKEN_LITERAL)
+    {
+        return false;
+    }
+    if (np.ppl.size == 0)
     {
-        UNKNOWN,
-        TEXT,
-        NUMBER,
-        STRING,
-        END,
-    } Match;
+        *out = np.noun;
+        return true;
+    }
 
-    Lexeme *lexemes = malloc(1000 * sizeof(Lexeme));
-    size_t lexemes_size = 0;
-    Lexeme lex;
-    Match mode = UNKNOWN;
-    const char *p = input;  // start of the lexeme
-    const char *q = input;  // end of the lexeme
-    int ln = 0;
-    int col = 0;
+    bool is_float = (np.noun.literal == LITERAL_FLOAT);
+    if (!is_float && (np.noun.literal != LITERAL_INTEGER))
+    {
+        return false;  // only numbers chain
+    }
+    long long iacc = is_float ? 0 : np.noun.value.integer;
+    double facc = is_float ? np.noun.value.floating : 0.0;
 
-    // parse tokens
-    while (*(p - 1) != '\0')  // use p - 1 in case file ends early
+    for (size_t i = 0; i < np.ppl.size; ++i)
     {
-        if (mode == UNKNOWN)
+        Token t = np.ppl.list[i].np.noun;
+        if (t.type != TOKEN_LITERAL)
         {
-            if (isspace(*p) || iscntrl(*p))
-            {
-                ++q; // do nothing, whitespace
-            }
-            else if (isalpha(*p))
-            {
-                mode = TEXT;
-            }
-            else if (*p == '"')
-            {
-                mode = STRING;
-            }
-            else if (*p == '.')
-            {
-                lexemes[lexemes_size] = ".";
-                ++lexemes_size;
-                q = p + 1;
-            }
-            else if (isdigit(*p))
-            {
-                mode = NUMBER;
-            }
-            else
-            {
-                fprintf(stderr,
-                        "Unknown lexeme %s at Ln %d, Col %d.\n",
-                        *p, ln, col);
-                exit(-1);
-            }
+            return false;
         }
-        else if (mode == TEXT)
+        if (t.literal == LITERAL_INTEGER)
         {
-            if (isspace(*p) || iscntrl(*p) || (*p == '.'))
+            if (is_float)
             {
-                // construct string
-                int str_size = p - q;
-                char *text = malloc((str_size + 1) * sizeof(char));
-                strncpy(text, q, str_size);
-                text[str_size] = '\0';
-
-                // construct token
-                lex = text;
-
-                // add token
-                lexemes[lexemes_size] = lex;
-                ++lexemes_size;
-                if (*p == '.')
-                {
-                    lexemes[lexemes_size] = ".";
-                    ++lexemes_size;
-                }
-                // clean
-                mode = UNKNOWN;
-                q = p + 1; // p will be incremented by one later
+                facc += (double) t.value.integer;
             }
-            else if (isalnum(*p))
+            else
             {
-                ; // continue to next
+                iacc += t.value.integer;
             }
         }
-        else if (mode == STRING)
+        else if (t.literal == LITERAL_FLOAT)
         {
-            if (*p == '\\')
+            if (!is_float)
             {
-                ++p;
-            }
-            else if (*p == '"')
-            {
-                // construct string
-                int str_size = p - q + 1; // plus one to include close quote
-                char *text = malloc((str_size + 1) * sizeof(char));
-                strncpy(text, q, str_size);
-                text[str_size] = '\0';
-
-                // construct token
-                lex = text;
-
-                // add token
-                lexemes[lexemes_size] = lex;
-                ++lexemes_size;
-
-                // clean
-                mode = UNKNOWN;
-                q = p + 1; // p will be incremented by one later
+                facc = (double) iacc;
+                is_float = true;
             }
+            facc += t.value.floating;
         }
-        else if (mode == NUMBER)
+        else
         {
-            // When we encounter a period, we need to lookahead to see if there
-            // is another number later
-            if (isdigit(*p) || (*p == '.' && isdigit(*(p + 1))))
-            {
-                ; // continue to next
-            }
-            else
-            {
-                // construct string
-                int str_size = p - q;
-                char *text = malloc((str_size + 1) * sizeof(char));
-                strncpy(text, q, str_size);
-                text[str_size] = '\0';
-
-                // construct token
-                lex = text;
-
-                // add token
-                lexemes[lexemes_size] = lex;
-                ++lexemes_size;
-                if (*p == '.')
-                {
-                    lexemes[lexemes_size] = ".";
-                    ++lexemes_size;
-                }
-                // clean
-                mode = UNKNOWN;
-                q = p + 1; // p will be incremented by one later
-            }
+            return false;
         }
-
-        ++p;
     }
 
-    return (LexemeList) {.list = lexemes, .size = lexemes_size};
+    *out = TOKEN_DEFAULT;
+    out->type = TOKEN_LITERAL;
+    if (is_float)
+    {
+        out->literal = LITERAL_FLOAT;
+        out->value.floating = facc;
+    }
+    else
+    {
+        out->literal = LITERAL_INTEGER;
+        out->value.integer = iacc;
+    }
+    return true;
 }
 
-/* Completes the process of Lexical Analysis by evaluating a list of Lexemes
- * and creating a list of Tokens.
- * (https://en.wikipedia.org/wiki/Lexical_analysis)
+
+// SYMBOL TABLE
+
+/* Tracks every variable the program defines: identifier InternId -> the
+ * type it was assigned and its definition ordinal (a handle for data
+ * offsets once variables move into a packed block). Open-addressed like
+ * the intern table; InternIds are already unique per spelling, so the
+ * id itself serves as the hash. Populated in a serial pre-pass over the
+ * sentences before codegen runs, which makes redefinition detection
+ * independent of the fragment cache and leaves the table read-only (and
+ * therefore safe to share) while parallel codegen workers consult it.
+ * Lives in the arena, so `symbol_reset()` must accompany every
+ * `arena_reset()`.
  */
-TokenList evaluate(LexemeList input)
+typedef struct Symbol
 {
-    Lexeme *lexemes = input.list;
-    // TODO: This shouldn't be static
-    Token *tokens = malloc(100 * sizeof(Token));
-    size_t tokens_size = 0;
+    InternId id;
+    Literal type;    // type of the literal the variable was assigned
+    size_t ordinal;  // definition order
+} Symbol;
 
-    for (int lex = 0; lex < input.size; ++lex)
-    {
-        Token curr = TOKEN_DEFAULT;
+#define SYMBOL_EMPTY ((uint32_t) -1)
+
+typedef struct SymbolTable
+{
+    Symbol *list;
+    size_t size;
+    size_t capacity;
+    uint32_t *slots;  // open-addressed: indices into `list`
+    size_t slot_count;
+} SymbolTable;
 
-        // keyword
-        // TODO: replace with binsearch, or hash
+static SymbolTable symbols = {NULL, 0, 0, NULL, 0};
 
-        for (int kw = 0; kw < KEYWORD_COUNT; ++kw)
+static void symbol_grow_slots(void)
+{
+    size_t slot_count = symbols.slot_count ? symbols.slot_count * 2 : 64;
+    uint32_t *slots = arena_alloc(slot_count * sizeof(uint32_t));
+    memset(slots, 0xff, slot_count * sizeof(uint32_t));
+    for (size_t i = 0; i < symbols.size; ++i)
+    {
+        size_t j = symbols.list[i].id % slot_count;
+        while (slots[j] != SYMBOL_EMPTY)
         {
-            if (!strcmp(lexemes[lex], KEYWORDS[kw]))
-            {
-                curr.type = TOKEN_KEYWORD;
-                curr.value = malloc(sizeof(Keyword));
-                * (Keyword *) curr.value = (Keyword) kw;
-                break;
-            }
+            j = (j + 1) % slot_count;
         }
-        if (curr.type != TOKEN_NULL)
+        slots[j] = (uint32_t) i;
+    }
+    symbols.slots = slots;
+    symbols.slot_count = slot_count;
+}
+
+Symbol *symbol_lookup(InternId id)
+{
+    if (symbols.slot_count == 0)
+    {
+        return NULL;
+    }
+    size_t i = id % symbols.slot_count;
+    while (symbols.slots[i] != SYMBOL_EMPTY)
+    {
+        if (symbols.list[symbols.slots[i]].id == id)
         {
-            tokens[tokens_size] = curr;
-            ++tokens_size;
-            continue;
+            return &symbols.list[symbols.slots[i]];
         }
+        i = (i + 1) % symbols.slot_count;
+    }
+    return NULL;
+}
 
-        // identifier
-
-        bool ident = true;
-        if (isalpha(*lexemes[lex]))  // is first character alpha?
-        {
-            const char *p = lexemes[lex];
-            while (*p != '\0')
-            {
-                if (!isalnum(*p) && (*p != '_'))
-                {
-                    ident = false;
-                    break;
-                }
-                ++p;
-            }
-        }
-        else
+/* Defines a variable; returns false if the id is already defined.
+ */
+bool symbol_define(InternId id, Literal type)
+{
+    if (symbol_lookup(id) != NULL)
+    {
+        return false;
+    }
+    if ((symbols.slot_count == 0) ||
+        (symbols.size * 3 >= symbols.slot_count * 2))
+    {
+        symbol_grow_slots();
+    }
+
+    Symbol sym = {.id = id, .type = type, .ordinal = symbols.size};
+    LIST_APPEND(symbols.list, symbols.size, symbols.capacity, Symbol, sym);
+
+    size_t i = id % symbols.slot_count;
+    while (symbols.slots[i] != SYMBOL_EMPTY)
+    {
+        i = (i + 1) % symbols.slot_count;
+    }
+    symbols.slots[i] = (uint32_t) (symbols.size - 1);
+    return true;
+}
+
+void symbol_reset(void)
+{
+    symbols.list = NULL;
+    symbols.size = 0;
+    symbols.capacity = 0;
+    symbols.slots = NULL;
+    symbols.slot_count = 0;
+}
+
+/* Reports every identifier the sentence reads that is not yet defined.
+ * The scan runs over sentences in source order in both the staged and
+ * pipelined paths, so this is what rejects forward references -- and it
+ * is the only place that reports them, which keeps the two paths'
+ * diagnostics identical (codegen stays silent on a missing symbol).
+ */
+static void symbol_check_use(Token t)
+{
+    if ((t.type == TOKEN_IDENTIFIER) &&
+        (symbol_lookup(t.value.name) == NULL))
+    {
+        diag_report(0, 0, "Use of undefined variable '%s'.",
+                    intern_string(t.value.name));
+    }
+}
+
+static void symbol_check_uses(Sentence s)
+{
+    if (!is_keyword(s.pred.verb, KEYWORD_KAMA) &&
+        !is_keyword(s.pred.verb, KEYWORD_SITELEN))
+    {
+        return;
+    }
+    // The operands codegen resolves: the object's head noun and each
+    // prepositional phrase's noun
+    symbol_check_use(s.pred.obj.noun);
+    for (size_t i = 0; i < s.pred.obj.ppl.size; ++i)
+    {
+        symbol_check_use(s.pred.obj.ppl.list[i].np.noun);
+    }
+}
+
+/* The pre-pass hook: checks the sentence's reads against the symbols
+ * defined so far (a variable must be defined before the sentence that
+ * reads it), then records the variable the sentence defines, reporting
+ * a redefinition up front instead of letting nasm fail late on a
+ * duplicate VARIABLE_ label.
+ */
+void symbol_scan_sentence(Sentence s)
+{
+    symbol_check_uses(s);
+    if ((s.subj.noun.type == TOKEN_IDENTIFIER) &&
+        is_keyword(s.pred.verb, KEYWORD_KAMA) &&
+        (s.pred.obj.noun.type != TOKEN_NULL))
+    {
+        // A fully-literal object carries its own type; runtime chains
+        // are integer-valued (see np_emit_eval)
+        Token folded;
+        Literal type = LITERAL_INTEGER;
+        if (np_fold(s.pred.obj, &folded))
         {
-            ident = false;
+            type = folded.literal;
         }
-        if (ident)
+        if (!symbol_define(s.subj.noun.value.name, type))
         {
-            curr.type = TOKEN_IDENTIFIER;
-            size_t size = sizeof(char) * strlen(lexemes[lex]);
-            curr.value = malloc(size);
-            strncpy((char *) curr.value, lexemes[lex], size);
-            ((char *) curr.value)[size] = '\0';
-            tokens[tokens_size] = curr;
-            ++tokens_size;
-            continue;
+            diag_report(0, 0, "Redefinition of variable '%s'.",
+                        intern_string(s.subj.noun.value.name));
         }
+    }
+}
 
-        // literals
+// INPUT
 
-        if (lexemes[lex][0] == '"')  // string literal
+/* Holds a whole source file as a NUL-terminated byte range, along with how
+ * it was acquired so `release_source()` knows how to give it back.
+ */
+typedef struct SourceFile
+{
+    const char *text;
+    size_t length;
+    bool mapped;  // true if `text` is an mmap'd region
+} SourceFile;
+
+/* Reads the source file `fname` for tokenization. On POSIX systems regular
+ * files are mapped read-only with `mmap`, so large sources are paged in
+ * lazily and never copied through userspace. The classic fseek/fread slurp
+ * is kept as a fallback for everything the map cannot serve: non-POSIX
+ * builds, pipes, empty files, and files whose size is an exact multiple of
+ * the page size (mapping those would leave no zero byte after the end for
+ * the tokenizer to stop on).
+ */
+SourceFile read_source(const char *fname)
+{
+#ifndef _WIN32
+    int fd = open(fname, O_RDONLY);
+    if (fd != -1)
+    {
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+            (st.st_size > 0) &&
+            (st.st_size % sysconf(_SC_PAGESIZE) != 0))
         {
-            curr.type = TOKEN_LITERAL;
-            const char *p = lexemes[lex] + 1, *q = lexemes[lex] + 1;
-            while (*p != '"')
+            void *map =
+                mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
             {
-                ++p;
+                // The tail of the last page past EOF reads as zero, which
+                // doubles as the terminator
+                close(fd);
+                return (SourceFile) {
+                    .text = map,
+                    .length = (size_t) st.st_size,
+                    .mapped = true};
             }
-            int str_size = p - q; // no +1 to get rid of end quote
-            size_t size = (str_size) * sizeof(CharLiteralType);
-            curr.value = malloc(size);
-            strncpy((StringLiteralType) curr.value, q, str_size);
-            curr.literal = LITERAL_STRING;
-            ((StringLiteralType) curr.value)[size] = '\0';
-            tokens[tokens_size] = curr;
-            ++tokens_size;
-            continue;
         }
-        else if (isdigit(lexemes[lex][0]))  // number literal
-        {
-            curr.type = TOKEN_LITERAL;
-            const char *p = lexemes[lex];
+        close(fd);
+    }
+#endif
 
-            // is it an integer, or a float?
-            bool integer = true;
-            while (*p)
-            {
-                if (*p == '.')
-                {
-                    integer = false;
-                    break;
-                }
-                ++p;
-            }
-            p = lexemes[lex]; // reset
+    FILE *fptr = fopen(fname, "rb");
 
-            if (integer)
-            {
-                curr.value = malloc(sizeof(IntegerLiteralType));
-                * (long long *) curr.value = strtoll(p, NULL, 10);
-                curr.literal = LITERAL_INTEGER;
-            }
-            else
-            {
-                curr.value = malloc(sizeof(FloatLiteralType));
-                * (double *) curr.value = strtod(p, NULL);
-                curr.literal = LITERAL_FLOAT;
-            }
-            tokens[tokens_size] = curr;
-            ++tokens_size;
-            continue;
-        }
+    if (fptr == NULL)
+    {
+        fprintf(
+            stderr,
+            "File \"%s\" not found.\n"
+            "  %s",
+            fname, strerror(errno));
+
+        exit(-1);
+    }
 
-        // separators
+    // from Nils Pipenbrinck on stack overflow
+    fseek(fptr, 0, SEEK_END);
+    long length = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
 
-        for (int sp = 0; sp < SEPARATOR_COUNT; ++sp)
+    char *buffer;
+    if (length >= 0)
+    {
+        buffer = malloc((length + 1) * sizeof(char));
+        if (buffer)
+        {
+            fread(buffer, 1, length, fptr);
+            buffer[length] = '\0';
+        }
+    }
+    else
+    {
+        // Not seekable (a pipe); read chunks until EOF instead
+        size_t capacity = 4096;
+        size_t used = 0;
+        buffer = malloc(capacity);
+        while (buffer)
         {
-            if (!strcmp(lexemes[lex], SEPARATORS[sp]))
+            used += fread(buffer + used, 1, capacity - used - 1, fptr);
+            if (used < capacity - 1)
             {
-                curr.type = TOKEN_SEPARATOR;
-                curr.value = malloc(sizeof(Separator));
-                * (Separator *) curr.value = (Separator)sp;
                 break;
             }
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
         }
-        if (curr.type != TOKEN_NULL)
+        if (buffer)
         {
-            tokens[tokens_size] = curr;
-            ++tokens_size;
-            continue;
+            buffer[used] = '\0';
         }
+        length = (long) used;
     }
 
-    return (TokenList){.list = tokens, .size = tokens_size};
-}
+    if (buffer == NULL)
+    {
+        fprintf(
+            stderr,
+            "Something went wrong reading file!"
+        );
+        exit(-1);
+    }
 
-// PARSING
+    fclose(fptr);
 
-/* Uses DCG to convert a `TokenList` into the information necessary to create
- * ASM. Puts information into the phrases defined under `Sentence`.
- * This process is significantly simplified by toki pona's use of particles
- * to denote the subject, object, and verb.
- * 
- * NOTE: Currently this language does not permit "nasin kijete" (free word
- * order). This feature may be available as a flag in the future.
- * 
- * PSR for toki (in their current state)
- * S --> (Literal) o sitelen e Literal
+    return (SourceFile) {
+        .text = buffer,
+        .length = (size_t) length,
+        .mapped = false};
+}
+
+/* Releases a `SourceFile` acquired with `read_source()`.
  */
-SentenceList parse(TokenList input)
+void release_source(SourceFile source)
 {
-    // currently not accounting for "la"
-    typedef enum Mode
+#ifndef _WIN32
+    if (source.mapped)
     {
-        PHRASE_EN,
-        PHRASE_O,
-        PHRASE_E,
-        PHRASE_PREP,
-    } Mode;
+        munmap((void *) source.text, source.length);
+        return;
+    }
+#endif
+    free((void *) source.text);
+}
 
-    Mode mode = PHRASE_EN;
+// LEXICAL ANALYSIS
 
-    Sentence s = SENTENCE_DEFAULT;
+/* Character classification. The tokenizer decides what to do with every
+ * single input byte, so instead of a ctype call per byte it looks the
+ * byte up in `CHAR_CLASS`, a 256-entry bitmask table built once from the
+ * ctype predicates the scanner cares about. On SSE2 targets the table is
+ * backed up by `skip_space()`/`skip_word()`, which classify 16 bytes per
+ * step to skip over runs of whitespace and identifier characters -- the
+ * two longest runs in real sources.
+ */
+enum
+{
+    CC_SPACE = 1 << 0,  // isspace or iscntrl
+    CC_ALPHA = 1 << 1,  // isalpha
+    CC_DIGIT = 1 << 2,  // isdigit
+    CC_WORD  = 1 << 3,  // isalnum or '_'
+};
 
-    TokenList buffer;
-    buffer.list = malloc(10 * sizeof(Token));
-    buffer.size = 0;
+static unsigned char CHAR_CLASS[256];
+static bool CHAR_CLASS_BUILT = false;
+
+#define char_is(c, mask) (CHAR_CLASS[(unsigned char) (c)] & (mask))
+
+/* Table-driven DFA for the multi-character token shapes. `scan_token()`
+ * used to re-test character classes in a per-shape if/else ladder; the
+ * hot loop is now one transition per byte -- state = matrix[state][class]
+ * -- with no data-dependent branches for the predictor to miss. The
+ * matrix is generated at startup from the token patterns in
+ * `build_scan_dfa()`, so a new token shape is a handful of table entries
+ * there rather than new branches in the loop.
+ *
+ * `SCAN_EQ` collapses the 256 bytes into the equivalence classes the
+ * patterns distinguish. `SCAN_KIND` marks the accepting states with the
+ * token shape they complete; the scan remembers the last accepting
+ * position and backtracks to it when the walk dies (maximal munch, so
+ * "12." scans as the integer 12 with the period left for the next
+ * token). `SCAN_LIVE` marks states with any outgoing transition: a walk
+ * that hits the end of a non-final chunk in a live state may continue
+ * in the next chunk, which is exactly the rescan condition.
+ */
+enum
+{
+    EQ_OTHER = 0,
+    EQ_ALPHA,   // [A-Za-z]
+    EQ_DIGIT,   // [0-9]
+    EQ_UNDER,   // '_'
+    EQ_DOT,     // '.'
+    EQ_QUOTE,   // '"'
+    EQ_BSLASH,  // '\\'
+    EQ_COUNT
+};
 
-    Token* head = NULL;
-    TokenList* tail = NULL;
-    PrepPhraseList* ppl = NULL;
+enum
+{
+    DFA_DEAD = 0,   // no transition; the walk is over
+    DFA_START,
+    DFA_WORD,       // [A-Za-z][A-Za-z0-9_]*
+    DFA_INT,        // [0-9]+
+    DFA_INT_DOT,    // integer then '.', fractional digits pending
+    DFA_FRAC,       // digits after a '.'
+    DFA_FRAC_DOT,   // fraction then another '.', digits pending
+    DFA_STR,        // inside a string literal
+    DFA_STR_ESC,    // inside a string literal, after a backslash
+    DFA_STR_END,    // past the closing quote
+    DFA_PERIOD,     // the sentence separator
+    DFA_STATE_COUNT
+};
 
-    Sentence *sl = malloc(50 * sizeof(Sentence));
-    size_t size = 0;
+enum
+{
+    KIND_NONE = 0,
+    KIND_WORD,
+    KIND_INT,
+    KIND_FLOAT,
+    KIND_STRING,
+    KIND_PERIOD
+};
 
-    Token *p = input.list;
+static unsigned char SCAN_EQ[256];
+static unsigned char SCAN_DFA[DFA_STATE_COUNT][EQ_COUNT];
+static unsigned char SCAN_KIND[DFA_STATE_COUNT];
+static bool SCAN_LIVE[DFA_STATE_COUNT];
 
-    // We use modes, and switch between them, updating as we go
-    // The current mode defines the head, tail, and ppl, and when we encounter
-    // anything that indicates we're switching modes, we add stuff in the buffer
-    // to the heads, and then finish switching modes. Rinse, repeat.
-    for (int i = 0; i < input.size; ++i)
+static void build_scan_dfa(void)
+{
+    for (int c = 0; c < 256; ++c)
     {
-        // Set head, tail, ppl
-        if (mode == PHRASE_EN)
+        unsigned char eq = EQ_OTHER;
+        if (isalpha(c))
+        {
+            eq = EQ_ALPHA;
+        }
+        else if (isdigit(c))
+        {
+            eq = EQ_DIGIT;
+        }
+        else if (c == '_')
         {
-            head = &(s.subj.noun);
-            tail = &(s.subj.adjp);
-            ppl  = &(s.subj.ppl);
+            eq = EQ_UNDER;
         }
-        else if (mode == PHRASE_O)
+        else if (c == '.')
         {
-            head = &(s.pred.verb);
-            tail = &(s.pred.advp);
-            ppl  = NULL;
+            eq = EQ_DOT;
         }
-        else if (mode == PHRASE_E)
+        else if (c == '"')
         {
-            head = &(s.pred.obj.noun);
-            tail = &(s.pred.obj.adjp);
-            ppl  = &(s.pred.obj.ppl);
+            eq = EQ_QUOTE;
         }
-        else if (mode == PHRASE_PREP)
+        else if (c == '\\')
         {
-            head = &(ppl->list[ppl->size].np.noun);
-            tail = &(ppl->list[ppl->size].np.adjp);
-            ppl  = NULL;
+            eq = EQ_BSLASH;
         }
+        SCAN_EQ[c] = eq;
+    }
+
+    memset(SCAN_DFA, DFA_DEAD, sizeof(SCAN_DFA));
+
+    // TEXT = [a-zA-Z][a-zA-Z0-9_]*
+    SCAN_DFA[DFA_START][EQ_ALPHA] = DFA_WORD;
+    SCAN_DFA[DFA_WORD][EQ_ALPHA] = DFA_WORD;
+    SCAN_DFA[DFA_WORD][EQ_DIGIT] = DFA_WORD;
+    SCAN_DFA[DFA_WORD][EQ_UNDER] = DFA_WORD;
+
+    // NUMBER = [0-9]+(\.[0-9]+)*
+    SCAN_DFA[DFA_START][EQ_DIGIT] = DFA_INT;
+    SCAN_DFA[DFA_INT][EQ_DIGIT] = DFA_INT;
+    SCAN_DFA[DFA_INT][EQ_DOT] = DFA_INT_DOT;
+    SCAN_DFA[DFA_INT_DOT][EQ_DIGIT] = DFA_FRAC;
+    SCAN_DFA[DFA_FRAC][EQ_DIGIT] = DFA_FRAC;
+    SCAN_DFA[DFA_FRAC][EQ_DOT] = DFA_FRAC_DOT;
+    SCAN_DFA[DFA_FRAC_DOT][EQ_DIGIT] = DFA_FRAC;
+
+    // STRING = ".*" with backslash escapes
+    SCAN_DFA[DFA_START][EQ_QUOTE] = DFA_STR;
+    for (int eq = 0; eq < EQ_COUNT; ++eq)
+    {
+        SCAN_DFA[DFA_STR][eq] = DFA_STR;
+        SCAN_DFA[DFA_STR_ESC][eq] = DFA_STR;
+    }
+    SCAN_DFA[DFA_STR][EQ_BSLASH] = DFA_STR_ESC;
+    SCAN_DFA[DFA_STR][EQ_QUOTE] = DFA_STR_END;
+
+    // '.'
+    SCAN_DFA[DFA_START][EQ_DOT] = DFA_PERIOD;
 
-        // Did we encounter something indicated a switch of mode?
-        if (is_keyword(*p, KEYWORD_O) || is_keyword(*p, KEYWORD_LI))
+    memset(SCAN_KIND, KIND_NONE, sizeof(SCAN_KIND));
+    SCAN_KIND[DFA_WORD] = KIND_WORD;
+    SCAN_KIND[DFA_INT] = KIND_INT;
+    SCAN_KIND[DFA_FRAC] = KIND_FLOAT;
+    SCAN_KIND[DFA_STR_END] = KIND_STRING;
+    SCAN_KIND[DFA_PERIOD] = KIND_PERIOD;
+
+    for (int s = 0; s < DFA_STATE_COUNT; ++s)
+    {
+        SCAN_LIVE[s] = false;
+        for (int eq = 0; eq < EQ_COUNT; ++eq)
         {
-            // Handle some invalid cases
-            if (mode == PHRASE_E)
-            {
-                fprintf(
-                    stderr,
-                    "Unimplemented: cannot use multiple predicates");
-                exit(-1);
-            }
-            else if (mode == PHRASE_O)
+            if (SCAN_DFA[s][eq] != DFA_DEAD)
             {
-                fprintf(
-                    stderr,
-                    "Unimplemented: cannot conjoin predicates");
-                exit(-1);
+                SCAN_LIVE[s] = true;
             }
+        }
+    }
+}
 
-            // Push buffer into sentence
-            if (buffer.size >= 1)
-            {
-                *head = buffer.list[0];
-            }
-            if (buffer.size >= 2)
-            {
-                *tail = (TokenList) {
-                    .list = buffer.list + 1,
-                    .size = buffer.size - 1};
-            }
+static void build_char_class(void)
+{
+    for (int c = 0; c < 256; ++c)
+    {
+        unsigned char cc = 0;
+        if (isspace(c) || iscntrl(c))
+        {
+            cc |= CC_SPACE;
+        }
+        if (isalpha(c))
+        {
+            cc |= CC_ALPHA;
+        }
+        if (isdigit(c))
+        {
+            cc |= CC_DIGIT;
+        }
+        if (isalnum(c) || (c == '_'))
+        {
+            cc |= CC_WORD;
+        }
+        CHAR_CLASS[c] = cc;
+    }
+    build_scan_dfa();
+    CHAR_CLASS_BUILT = true;
+}
+
+#ifdef __SSE2__
+
+/* Compares 16 unsigned bytes against [lo, hi] at once.
+ */
+static inline __m128i sse2_in_range(__m128i v, unsigned char lo,
+                                    unsigned char hi)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8((char) lo));
+    __m128i limit = _mm_set1_epi8((char) (hi - lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, limit), t);
+}
 
-            // Switch mode, reset buffer
-            mode = PHRASE_O;
-            buffer.list = malloc(10 * sizeof(Token));
-            buffer.size = 0;
+/* Advances past a run of CC_SPACE bytes (everything at or below 0x20,
+ * plus DEL) 16 at a time, finishing the tail with the table.
+ */
+static const char *skip_space(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        __m128i space = _mm_or_si128(
+            sse2_in_range(v, 0, 0x20),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+        int mask = _mm_movemask_epi8(space);
+        if (mask != 0xffff)
+        {
+            return p + __builtin_ctz(~mask);
         }
-        else if (is_keyword(*p, KEYWORD_KIN))
+        p += 16;
+    }
+    while ((p < end) && char_is(*p, CC_SPACE))
+    {
+        ++p;
+    }
+    return p;
+}
+
+/* Advances past a run of CC_WORD bytes ([0-9A-Za-z_]) 16 at a time,
+ * finishing the tail with the table.
+ */
+static const char *skip_word(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        __m128i word = _mm_or_si128(
+            _mm_or_si128(sse2_in_range(v, '0', '9'),
+                         sse2_in_range(v, 'A', 'Z')),
+            _mm_or_si128(sse2_in_range(v, 'a', 'z'),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+        int mask = _mm_movemask_epi8(word);
+        if (mask != 0xffff)
         {
-            // Handle some invalid cases
-            if (mode == PHRASE_O)
-            {
-                fprintf(
-                    stderr,
-                    "Prepositions not allowed after verb phrases.");
-                exit(-1);
-            }
-            else if (buffer.size == 0)
-            {
-                fprintf(
-                    stderr,
-                    "Monadic 'sin' is not allowed.");
-                exit(-1);
-            }
+            return p + __builtin_ctz(~mask);
+        }
+        p += 16;
+    }
+    while ((p < end) && char_is(*p, CC_WORD))
+    {
+        ++p;
+    }
+    return p;
+}
 
-            // Push buffer into sentence
-            if (buffer.size >= 1)
-            {
-                *head = buffer.list[0];
-            }
-            if (buffer.size >= 2)
-            {
-                s.subj.noun = buffer.list[0];
-                s.subj.adjp = (TokenList) {
-                    .list = buffer.list + 1,
-                    .size = buffer.size - 1};
-            }
+#endif  // __SSE2__
+
+/* Keyword recognition. Scanning every entry of `KEYWORDS[]` with `strcmp`
+ * is O(keywords) per word, which stops being cheap once the dictionary
+ * grows toward the full toki pona vocabulary. Instead, each word is hashed
+ * on its length and first/last characters into `KEYWORD_TABLE`, which is
+ * built once from `KEYWORDS[]` on the first call to `keyword_lookup()`, so
+ * classification is a single hash-and-compare.
+ * The hash is collision free for the current keyword set (asserted while
+ * the table is built); if adding a keyword ever trips that assert, bump
+ * `KEYWORD_TABLE_SIZE` or adjust `keyword_hash()`.
+ * The table stores `Keyword` enum values, so the KEYWORDS/Keyword ordering
+ * guarantee is untouched.
+ * Separators need no table: they are all single characters, matched
+ * structurally in `tokenize()`.
+ */
+#define KEYWORD_TABLE_SIZE 64
+
+static int KEYWORD_TABLE[KEYWORD_TABLE_SIZE];
+static bool KEYWORD_TABLE_BUILT = false;
+
+static inline unsigned int keyword_hash(const char *word, size_t len)
+{
+    return (len
+            + (unsigned char) word[0]
+            + 3 * (unsigned char) word[len - 1]) % KEYWORD_TABLE_SIZE;
+}
+
+static void build_keyword_table(void)
+{
+    for (int i = 0; i < KEYWORD_TABLE_SIZE; ++i)
+    {
+        KEYWORD_TABLE[i] = -1;
+    }
+    for (int kw = 0; kw < KEYWORD_COUNT; ++kw)
+    {
+        unsigned int h = keyword_hash(KEYWORDS[kw], strlen(KEYWORDS[kw]));
+        assert(KEYWORD_TABLE[h] == -1);  // hash no longer perfect, see above
+        KEYWORD_TABLE[h] = kw;
+    }
+    KEYWORD_TABLE_BUILT = true;
+}
+
+/* Returns the `Keyword` matching `word` (which need not be terminated;
+ * only the first `len` characters are considered), or -1 if the word is
+ * not a keyword.
+ */
+static int keyword_lookup(const char *word, size_t len)
+{
+    if (!KEYWORD_TABLE_BUILT)
+    {
+        build_keyword_table();
+    }
+    int kw = KEYWORD_TABLE[keyword_hash(word, len)];
+    if ((kw != -1) &&
+        (strlen(KEYWORDS[kw]) == len) &&
+        !strncmp(word, KEYWORDS[kw], len))
+    {
+        return kw;
+    }
+    return -1;
+}
+
+/* Scans exactly one token starting at `p`, which must not point at
+ * whitespace. `eof` says whether `end` is the true end of the input or
+ * just the end of the bytes read so far; when it is not, a token that
+ * runs into `end` may continue in the next chunk, so NULL is returned
+ * (emit nothing, refill, rescan) instead of a token cut in half.
+ * `err_base`/`err_ln_base` seed the line/column recovery on the
+ * unknown-lexeme path; in chunked mode they are best effort relative to
+ * the current chunk. The input must have a NUL at `end` (both whole-file
+ * buffers and the stream chunk buffer guarantee one).
+ */
+static const char *scan_token(const char *p, const char *end, bool eof,
+                              const char *err_base, int err_ln_base,
+                              Token *out)
+{
+    Token curr = TOKEN_DEFAULT;
 
-            ppl->list[ppl->size].prep = *p;
+    const char *q = p;  // start of the lexeme
+    int state = DFA_START;
+    int kind = KIND_NONE;
+    const char *accept_end = NULL;
+    bool terminated = false;  // a string saw its closing quote
 
-            // Switch mode, reset buffer
-            mode = PHRASE_PREP;
-            buffer.list = malloc(10 * sizeof(Token));
-            buffer.size = 0;            
+    while (p < end)
+    {
+        int next = SCAN_DFA[state][SCAN_EQ[(unsigned char) *p]];
+        if (next == DFA_DEAD)
+        {
+            break;
         }
-        else if (is_keyword(*p, KEYWORD_E))
+        state = next;
+        ++p;
+        if (SCAN_KIND[state] != KIND_NONE)
         {
-            // Handle some invalid cases
-            if (mode == PHRASE_EN)
-            {
-                fprintf(
-                    stderr,
-                    "Error, invalid word order SO");
-                exit(-1);
-                // wait till nasin kijete flag is implemented!
-            }
+            kind = SCAN_KIND[state];
+            accept_end = p;
+            terminated = (state == DFA_STR_END);
+        }
+#ifdef __SSE2__
+        if (state == DFA_WORD)
+        {
+            // Word runs are the longest in real sources; bulk-skip
+            // them 16 bytes at a time. The next transition on the
+            // non-word byte that stopped the skip ends the walk.
+            p = skip_word(p, end);
+            accept_end = p;
+        }
+#endif
+    }
 
-            // Push buffer into sentence
-            if (buffer.size >= 1)
-            {
-                *head = buffer.list[0];
-            }
-            if (buffer.size >= 2)
+    if ((p == end) && !eof && SCAN_LIVE[state])
+    {
+        return NULL;  // the token may continue in the next chunk
+    }
+    if ((kind == KIND_NONE) && ((state == DFA_STR) ||
+                                (state == DFA_STR_ESC)))
+    {
+        // An unterminated string at the true end of input runs to it
+        kind = KIND_STRING;
+        accept_end = p;
+    }
+
+    if (kind == KIND_NONE)
+    {
+        // This path is cold, so the line and column are recovered here
+        // instead of being tracked on every byte
+        int ln = err_ln_base;
+        const char *line_start = err_base;
+        for (const char *t = err_base; t < q; ++t)
+        {
+            if (*t == '\n')
             {
-                *tail = (TokenList) {
-                    .list = buffer.list + 1,
-                    .size = buffer.size - 1};
+                ++ln;
+                line_start = t + 1;
             }
+        }
+        diag_report(ln, (int) (q - line_start) + 1,
+                    "Unknown lexeme %c.", *q);
 
-            // Switch mode, reset buffer
-            mode = PHRASE_E;
-            buffer.list = malloc(10 * sizeof(Token));
-            buffer.size = 0;
+        // Skip the byte and keep scanning; the caller drops TOKEN_NULL
+        *out = curr;
+        return q + 1;
+    }
+
+    p = accept_end;  // backtrack past any dead-end suffix of the walk
+
+    switch (kind)
+    {
+        case KIND_PERIOD:
+        {
+            curr.type = TOKEN_SEPARATOR;
+            curr.value.separator = SEPARATOR_PERIOD;
+            break;
         }
-        else if (is_seperator(*p, SEPARATOR_PERIOD))
+        case KIND_WORD:
         {
-            // Push buffer into sentence
-            if (buffer.size >= 1)
+            size_t len = p - q;
+            int kw = keyword_lookup(q, len);
+            if (kw != -1)
             {
-                *head = buffer.list[0];
+                curr.type = TOKEN_KEYWORD;
+                curr.value.keyword = (Keyword) kw;
             }
-            if (buffer.size >= 2)
+            else
             {
-                *tail = (TokenList) {
-                    .list = buffer.list + 1,
-                    .size = buffer.size - 1};
+                curr.type = TOKEN_IDENTIFIER;
+                curr.value.name = intern(q, len);
             }
-
-            // Switch mode, reset buffer
-            mode = PHRASE_EN;  // set PHRASE_EN here for next sentence
-            buffer.list = malloc(10 * sizeof(Token));
-            buffer.size = 0;
-
-            // Start new sentence
-            sl[size] = s;
-            s = SENTENCE_DEFAULT;
-            ++size;
+            break;
         }
-        // Identifiers/Literals, add to the buffer
-        else
+        case KIND_INT:
+        {
+            curr.type = TOKEN_LITERAL;
+            curr.literal = LITERAL_INTEGER;
+            curr.value.integer = strtoll(q, NULL, 10);
+            break;
+        }
+        case KIND_FLOAT:
+        {
+            curr.type = TOKEN_LITERAL;
+            curr.literal = LITERAL_FLOAT;
+            curr.value.floating = strtod(q, NULL);
+            break;
+        }
+        case KIND_STRING:
+        {
+            // The lexeme sits between the quotes; an unterminated one
+            // has no closing quote to trim
+            size_t len = (p - (q + 1)) - (terminated ? 1 : 0);
+            curr.type = TOKEN_LITERAL;
+            curr.literal = LITERAL_STRING;
+            curr.value.string = intern(q + 1, len);
+            break;
+        }
+    }
+
+    *out = curr;
+    return p;
+}
+
+/* Performs the entire process of Lexical Analysis in a single streaming
+ * pass, classifying characters and emitting Tokens directly from the input
+ * buffer. There is no intermediate Lexeme representation; each Token is
+ * built exactly once, from the slice of input it matched. Classification
+ * goes through `CHAR_CLASS` (and the SSE2 run skips where available)
+ * rather than per-byte ctype calls.
+ * 
+ * Matches:
+ * TEXT   = [a-zA-Z][a-zA-Z0-9_]*
+ * NUMBER = [0-9]+(\.[0-9]+)
+ * STRING = ".*"
+ */
+TokenList tokenize(const char *input, size_t length)
+{
+    if (!CHAR_CLASS_BUILT)
+    {
+        build_char_class();
+    }
+
+    TokenList tokens = TOKENLIST_DEFAULT;
+
+    const char *p = input;
+    const char *end = input + length;
+
+    while (p < end)
+    {
+        if (char_is(*p, CC_SPACE))
+        {
+            // do nothing, whitespace
+#ifdef __SSE2__
+            p = skip_space(p, end);
+#else
+            ++p;
+#endif
+            continue;
+        }
+
+        Token curr;
+        p = scan_token(p, end, true, input, 1, &curr);
+        if (curr.type != TOKEN_NULL)
+        {
+            LIST_APPEND(tokens.list, tokens.size, tokens.capacity, Token,
+                        curr);
+        }
+    }
+
+    return tokens;
+}
+
+/* Tokenizes a stream in fixed-size chunks, carrying partial-token state
+ * across chunk boundaries, so tokenization memory stays O(chunk + tokens)
+ * no matter how large the source is. Tokens never point into the chunk
+ * buffer (identifiers and strings are interned, numbers are parsed on the
+ * spot), so the buffer is reused for every refill; only a single token
+ * longer than the whole buffer (a huge string literal) forces it to grow.
+ */
+#define STREAM_CHUNK_SIZE (1 << 16)
+
+TokenList tokenize_stream(FILE *stream)
+{
+    if (!CHAR_CLASS_BUILT)
+    {
+        build_char_class();
+    }
+
+    TokenList tokens = TOKENLIST_DEFAULT;
+
+    size_t capacity = STREAM_CHUNK_SIZE;
+    char *buffer = malloc(capacity);
+    size_t filled = 0;
+    bool eof = false;
+    // 1-based line of the buffer's first byte, for error reporting
+    int ln_consumed = 1;
+
+    while (true)
+    {
+        size_t got = fread(buffer + filled, 1, capacity - filled - 1,
+                           stream);
+        filled += got;
+        buffer[filled] = '\0';
+        if (got == 0)
+        {
+            eof = true;
+        }
+
+        const char *p = buffer;
+        const char *end = buffer + filled;
+        const char *pending = NULL;  // start of an incomplete token
+
+        while (p < end)
+        {
+            if (char_is(*p, CC_SPACE))
+            {
+#ifdef __SSE2__
+                p = skip_space(p, end);
+#else
+                ++p;
+#endif
+                continue;
+            }
+
+            Token curr;
+            const char *next =
+                scan_token(p, end, eof, buffer, ln_consumed, &curr);
+            if (next == NULL)
+            {
+                pending = p;
+                break;
+            }
+            p = next;
+            if (curr.type != TOKEN_NULL)
+            {
+                LIST_APPEND(tokens.list, tokens.size, tokens.capacity,
+                            Token, curr);
+            }
+        }
+
+        if (eof)
+        {
+            break;
+        }
+
+        // Carry the incomplete tail (if any) to the front of the buffer,
+        // counting the lines being discarded
+        const char *keep = pending ? pending : end;
+        for (const char *t = buffer; t < keep; ++t)
+        {
+            if (*t == '\n')
+            {
+                ++ln_consumed;
+            }
+        }
+        filled = end - keep;
+        memmove(buffer, keep, filled);
+
+        // A single token filled the whole buffer; grow it
+        if (filled == capacity - 1)
+        {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+    }
+
+    free(buffer);
+    return tokens;
+}
+
+
+// TOKEN CACHE
+
+/* Binary token-stream cache for sources that are tokenized repeatedly
+ * (CI re-compiling the same generated corpus). The whole front end's
+ * output is persisted next to the source as `<source>.tokens`: a small
+ * header, the `TokenList` as flat fixed-width records, and the intern
+ * string table the records' InternIds index into. The records on disk
+ * are in-memory `Token`s verbatim, so a warm compile mmaps the file,
+ * re-interns the stored strings (restoring the same sequential ids) and
+ * points the TokenList straight into the mapping -- scanning is skipped
+ * entirely and the warm front end costs one mmap plus the intern
+ * replay. Freshness is checked against the source's size and mtime. The
+ * cache is machine-local (native byte order and struct layout) and,
+ * like the mmap input path, POSIX-only; a stale, foreign or missing
+ * file just means one cold scan that rewrites it.
+ */
+#define TOKEN_CACHE_MAGIC 0x314b4f54u  // "TOK1"
+
+typedef struct TokenCacheHeader
+{
+    uint32_t magic;
+    uint32_t record_size;   // sizeof(Token) at write time
+    uint64_t source_size;   // stat of the source when cached
+    uint64_t source_mtime;
+    uint64_t token_count;
+    uint64_t intern_count;
+    uint64_t reserved[3];   // pads the header to 64 bytes, keeping the
+                            // record array 16-aligned in the mapping
+} TokenCacheHeader;
+
+static char *token_cache_path(const char *fname)
+{
+    char *path = malloc(strlen(fname) + sizeof(".tokens"));
+    strcpy(path, fname);
+    strcat(path, ".tokens");
+    return path;
+}
+
+/* Tries to serve `fname`'s token stream from its cache. On a hit,
+ * `*out` points into the mapping described by `*mapping` (release with
+ * `release_source()` once parsing and codegen are done) and the intern
+ * table has been replayed.
+ */
+bool token_cache_load(const char *fname, TokenList *out,
+                      SourceFile *mapping)
+{
+    *mapping = (SourceFile) {.text = NULL, .length = 0, .mapped = false};
+#ifdef _WIN32
+    (void) fname;
+    (void) out;
+    return false;
+#else
+    struct stat source_st;
+    if (stat(fname, &source_st) != 0)
+    {
+        return false;
+    }
+
+    char *path = token_cache_path(fname);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) ||
+        ((size_t) st.st_size < sizeof(TokenCacheHeader)))
+    {
+        close(fd);
+        return false;
+    }
+
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const TokenCacheHeader *header = (const TokenCacheHeader *) base;
+    size_t records_size = header->token_count * sizeof(Token);
+    if ((header->magic != TOKEN_CACHE_MAGIC) ||
+        (header->record_size != sizeof(Token)) ||
+        (header->source_size != (uint64_t) source_st.st_size) ||
+        (header->source_mtime != (uint64_t) source_st.st_mtime) ||
+        (sizeof(TokenCacheHeader) + records_size > (size_t) st.st_size))
+    {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    // Replay the intern table; sequential interning into the fresh
+    // table restores the exact ids the records were written with
+    const char *p = base + sizeof(TokenCacheHeader) + records_size;
+    const char *end = base + st.st_size;
+    for (uint64_t i = 0; i < header->intern_count; ++i)
+    {
+        uint32_t length;
+        if (p + sizeof(length) > end)
+        {
+            munmap(base, st.st_size);
+            intern_reset();
+            return false;
+        }
+        memcpy(&length, p, sizeof(length));
+        p += sizeof(length);
+        if (p + length > end)
+        {
+            munmap(base, st.st_size);
+            intern_reset();
+            return false;
+        }
+        intern(p, length);
+        p += length;
+    }
+
+    out->list = (Token *) (base + sizeof(TokenCacheHeader));
+    out->size = header->token_count;
+    out->capacity = header->token_count;
+    *mapping = (SourceFile) {
+        .text = base,
+        .length = (size_t) st.st_size,
+        .mapped = true};
+    return true;
+#endif
+}
+
+/* Persists a freshly scanned token stream next to its source.
+ * Best-effort, like the fragment cache: failure just costs the next
+ * compile a scan.
+ */
+void token_cache_save(const char *fname, TokenList tokens)
+{
+#ifdef _WIN32
+    (void) fname;
+    (void) tokens;
+#else
+    struct stat source_st;
+    if (stat(fname, &source_st) != 0)
+    {
+        return;
+    }
+
+    char *path = token_cache_path(fname);
+    FILE *fptr = fopen(path, "wb");
+    free(path);
+    if (fptr == NULL)
+    {
+        return;
+    }
+
+    TokenCacheHeader header = {
+        .magic = TOKEN_CACHE_MAGIC,
+        .record_size = sizeof(Token),
+        .source_size = (uint64_t) source_st.st_size,
+        .source_mtime = (uint64_t) source_st.st_mtime,
+        .token_count = tokens.size,
+        .intern_count = interns.size,
+        .reserved = {0, 0, 0}};
+    fwrite(&header, sizeof(header), 1, fptr);
+    fwrite(tokens.list, sizeof(Token), tokens.size, fptr);
+    for (size_t i = 0; i < interns.size; ++i)
+    {
+        uint32_t length = (uint32_t) strlen(interns.strings[i]);
+        fwrite(&length, sizeof(length), 1, fptr);
+        fwrite(interns.strings[i], 1, length, fptr);
+    }
+    fclose(fptr);
+#endif
+}
+
+// PARSING
+
+/* Uses DCG to convert Tokens into the information necessary to create
+ * ASM. Puts information into the phrases defined under `Sentence`.
+ * This process is significantly simplified by toki pona's use of particles
+ * to denote the subject, object, and verb.
+ * 
+ * The parser is incremental: `parser_feed()` takes one Token at a time
+ * and returns true whenever a period completes a Sentence, storing it in
+ * `*out`. `parse()` drives it over a whole TokenList; the pipelined
+ * compile path feeds it straight from the scanner, compiling each
+ * Sentence the moment it completes.
+ * 
+ * NOTE: Currently this language does not permit "nasin kijete" (free word
+ * order). This feature may be available as a flag in the future.
+ * 
+ * PSR for toki (in their current state)
+ * S --> (Literal) o sitelen e Literal
+ */
+
+// currently not accounting for "la"
+typedef enum ParseMode
+{
+    PHRASE_EN,
+    PHRASE_O,
+    PHRASE_E,
+    PHRASE_PREP,
+} ParseMode;
+
+typedef struct Parser
+{
+    ParseMode mode;
+    Sentence s;           // the sentence being built
+    TokenList buffer;     // tokens of the phrase being built
+    PrepPhraseList *ppl;  // the list PHRASE_PREP appends into
+    bool poisoned;        // error recorded; discarding until a period
+    // phrase-buffer pool: token buffers and prep-phrase arrays recovered
+    // from consumed Sentences (see parser_recycle), reused instead of
+    // growing fresh ones out of the arena on every phrase
+    TokenList *free_buffers;
+    size_t free_buffer_size;
+    size_t free_buffer_capacity;
+    PrepPhraseList *free_ppls;
+    size_t free_ppl_size;
+    size_t free_ppl_capacity;
+} Parser;
+
+void parser_init(Parser *pr)
+{
+    pr->mode = PHRASE_EN;
+    pr->s = SENTENCE_DEFAULT;
+    pr->buffer = TOKENLIST_DEFAULT;
+    pr->ppl = NULL;
+    pr->poisoned = false;
+    pr->free_buffers = NULL;
+    pr->free_buffer_size = 0;
+    pr->free_buffer_capacity = 0;
+    pr->free_ppls = NULL;
+    pr->free_ppl_size = 0;
+    pr->free_ppl_capacity = 0;
+}
+
+static TokenList parser_take_buffer(Parser *pr)
+{
+    if (pr->free_buffer_size > 0)
+    {
+        TokenList buffer = pr->free_buffers[--pr->free_buffer_size];
+        buffer.size = 0;
+        return buffer;
+    }
+    return TOKENLIST_DEFAULT;
+}
+
+/* Pushes the buffered phrase into `*head`/`*tail`. The first
+ * MODIFIER_INLINE modifiers are copied into the phrase's inline slots,
+ * so the common short phrase takes no reference into the buffer at all
+ * and the buffer is reused in place; only longer phrases copy the
+ * remainder into a pooled (or fresh) spill list.
+ */
+static void parser_push_phrase(Parser *pr, Token *head, ModifierList *tail)
+{
+    if (pr->buffer.size >= 1)
+    {
+        *head = pr->buffer.list[0];
+    }
+    if (pr->buffer.size >= 2)
+    {
+        size_t count = pr->buffer.size - 1;
+        tail->size = count;
+        size_t inline_count =
+            (count < MODIFIER_INLINE) ? count : MODIFIER_INLINE;
+        memcpy(tail->head, pr->buffer.list + 1,
+               inline_count * sizeof(Token));
+        if (count > MODIFIER_INLINE)
+        {
+            tail->spill = parser_take_buffer(pr);
+            for (size_t i = MODIFIER_INLINE; i < count; ++i)
+            {
+                LIST_APPEND(tail->spill.list, tail->spill.size,
+                            tail->spill.capacity, Token,
+                            pr->buffer.list[1 + i]);
+            }
+        }
+    }
+    pr->buffer.size = 0;
+}
+
+static void parser_recycle_tokens(Parser *pr, ModifierList modifiers)
+{
+    if (modifiers.spill.list == NULL)
+    {
+        return;
+    }
+    modifiers.spill.size = 0;
+    LIST_APPEND(pr->free_buffers, pr->free_buffer_size,
+                pr->free_buffer_capacity, TokenList, modifiers.spill);
+}
+
+static void parser_recycle_np(Parser *pr, NounPhrase np)
+{
+    parser_recycle_tokens(pr, np.adjp);
+    for (size_t i = 0; i < np.ppl.size; ++i)
+    {
+        parser_recycle_tokens(pr, np.ppl.list[i].np.adjp);
+    }
+    if (np.ppl.list != NULL)
+    {
+        PrepPhraseList ppl = {
+            .list = np.ppl.list,
+            .size = 0,
+            .capacity = np.ppl.capacity};
+        LIST_APPEND(pr->free_ppls, pr->free_ppl_size,
+                    pr->free_ppl_capacity, PrepPhraseList, ppl);
+    }
+}
+
+/* Returns a consumed Sentence's spill lists and prep-phrase arrays to
+ * the parser's pool. Call only once the Sentence will not be read
+ * again: the pipelined path recycles right after codegen, so its
+ * steady-state parsing performs no allocations at all. The staged path
+ * keeps every Sentence alive in its SentenceList and therefore never
+ * recycles.
+ */
+void parser_recycle(Parser *pr, Sentence s)
+{
+    parser_recycle_np(pr, s.subj);
+    parser_recycle_tokens(pr, s.pred.advp);
+    parser_recycle_np(pr, s.pred.obj);
+}
+
+/* Feeds one Token to the parser. Returns true if the Token completed a
+ * Sentence, which is then stored in `*out`.
+ * 
+ * We use modes, and switch between them, updating as we go. The current
+ * mode defines the head, tail, and ppl, and when we encounter anything
+ * that indicates we're switching modes, we add stuff in the buffer to the
+ * heads, and then finish switching modes. Rinse, repeat.
+ */
+bool parser_feed(Parser *pr, Token t, Sentence *out)
+{
+    // Error recovery: discard tokens until the period that ends the
+    // poisoned sentence, then start the next one clean
+    if (pr->poisoned)
+    {
+        if (is_seperator(t, SEPARATOR_PERIOD))
+        {
+            pr->poisoned = false;
+            pr->mode = PHRASE_EN;
+            pr->s = SENTENCE_DEFAULT;
+            pr->buffer.size = 0;
+            pr->ppl = NULL;
+        }
+        return false;
+    }
+
+    Token *head = NULL;
+    ModifierList *tail = NULL;
+
+    // Set head, tail, ppl
+    if (pr->mode == PHRASE_EN)
+    {
+        head = &(pr->s.subj.noun);
+        tail = &(pr->s.subj.adjp);
+        pr->ppl = &(pr->s.subj.ppl);
+    }
+    else if (pr->mode == PHRASE_O)
+    {
+        head = &(pr->s.pred.verb);
+        tail = &(pr->s.pred.advp);
+        pr->ppl = NULL;
+    }
+    else if (pr->mode == PHRASE_E)
+    {
+        head = &(pr->s.pred.obj.noun);
+        tail = &(pr->s.pred.obj.adjp);
+        pr->ppl = &(pr->s.pred.obj.ppl);
+    }
+    else if (pr->mode == PHRASE_PREP)
+    {
+        head = &(pr->ppl->list[pr->ppl->size - 1].np.noun);
+        tail = &(pr->ppl->list[pr->ppl->size - 1].np.adjp);
+        // ppl stays put, so chained prepositions append to the same list
+    }
+
+    // Did we encounter something indicated a switch of mode?
+    if (is_keyword(t, KEYWORD_O) || is_keyword(t, KEYWORD_LI))
+    {
+        // Handle some invalid cases
+        if (pr->mode == PHRASE_E)
+        {
+            diag_report(0, 0, "Unimplemented: cannot use multiple predicates.");
+            pr->poisoned = true;
+            return false;
+        }
+        else if (pr->mode == PHRASE_O)
+        {
+            diag_report(0, 0, "Unimplemented: cannot conjoin predicates.");
+            pr->poisoned = true;
+            return false;
+        }
+
+        // Push buffer into sentence
+        parser_push_phrase(pr, head, tail);
+
+        // Switch mode (parser_push_phrase renewed the buffer)
+        pr->mode = PHRASE_O;
+    }
+    else if (is_keyword(t, KEYWORD_KIN))
+    {
+        // Handle some invalid cases
+        if (pr->mode == PHRASE_O)
+        {
+            diag_report(0, 0, "Prepositions not allowed after verb phrases.");
+            pr->poisoned = true;
+            return false;
+        }
+        else if (pr->buffer.size == 0)
+        {
+            diag_report(0, 0, "Monadic 'sin' is not allowed.");
+            pr->poisoned = true;
+            return false;
+        }
+
+        // Push buffer into sentence
+        parser_push_phrase(pr, head, tail);
+
+        // Reuse a pooled prep-phrase array before growing a fresh one
+        if ((pr->ppl->list == NULL) && (pr->free_ppl_size > 0))
+        {
+            *pr->ppl = pr->free_ppls[--pr->free_ppl_size];
+        }
+        PrepPhrase pp = PREPPHRASE_DEFAULT;
+        pp.prep = t;
+        LIST_APPEND(pr->ppl->list, pr->ppl->size, pr->ppl->capacity,
+                    PrepPhrase, pp);
+
+        // Switch mode (parser_push_phrase renewed the buffer)
+        pr->mode = PHRASE_PREP;
+    }
+    else if (is_keyword(t, KEYWORD_E))
+    {
+        // Handle some invalid cases
+        if (pr->mode == PHRASE_EN)
+        {
+            // wait till nasin kijete flag is implemented!
+            diag_report(0, 0, "Error, invalid word order SO.");
+            pr->poisoned = true;
+            return false;
+        }
+
+        // Push buffer into sentence
+        parser_push_phrase(pr, head, tail);
+
+        // Switch mode (parser_push_phrase renewed the buffer)
+        pr->mode = PHRASE_E;
+    }
+    else if (is_seperator(t, SEPARATOR_PERIOD))
+    {
+        // Push buffer into sentence
+        parser_push_phrase(pr, head, tail);
+
+        // Complete the sentence, reset for the next one
+        *out = pr->s;
+        pr->mode = PHRASE_EN;
+        pr->s = SENTENCE_DEFAULT;
+        pr->ppl = NULL;
+        return true;
+    }
+    // Identifiers/Literals, add to the buffer
+    else
+    {
+        LIST_APPEND(pr->buffer.list, pr->buffer.size, pr->buffer.capacity,
+                    Token, t);
+    }
+
+    return false;
+}
+
+/* Parses a whole TokenList into a SentenceList.
+ */
+SentenceList parse(TokenList input)
+{
+    Parser parser;
+    parser_init(&parser);
+
+    SentenceList sentences = {.list = NULL, .size = 0, .capacity = 0};
+
+    for (int i = 0; i < input.size; ++i)
+    {
+        Sentence s;
+        if (parser_feed(&parser, input.list[i], &s))
+        {
+            LIST_APPEND(sentences.list, sentences.size, sentences.capacity,
+                        Sentence, s);
+        }
+    }
+
+    return sentences;
+}
+
+// COMPILING
+
+/* These are helper functions which help significantly reduce the necessary code
+ * for inputing lines of ASM into `SectionData` and `SectionText`.
+ */
+/* Budget mode (--budget <bytes>). The section buffers normally hold
+ * every formatted line until the final write, which for a large enough
+ * generated program is the biggest allocation in the compiler. With a
+ * budget set, the pipelined path marks its merged sections spillable:
+ * once the lines held in memory pass half the budget (each section gets
+ * half), the section dumps them to an unlinked temp file and every
+ * later line streams straight there -- already indented, so the final
+ * write is a plain byte copy -- keeping peak memory flat no matter how
+ * large the program is. Zero keeps the all-in-memory fast path.
+ */
+static size_t memory_budget = 0;
+
+static void spill_lines(FILE *spill, const char *indent,
+                        const char **lines, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        fputs(indent, spill);
+        fputs(lines[i], spill);
+        fputc('\n', spill);
+    }
+}
+
+void write_into_data(SectionData *data, uint32_t label, const char *assembly,
+                     ...)
+{
+    // A nonzero `label` says the line defines that data-section label;
+    // such a line is emitted only once per output, so identical string
+    // literals share one definition.
+    if ((label != 0) && !u32set_add(&data->emitted, label))
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, assembly);
+
+    if (data->spill != NULL)
+    {
+        fputs("    ", data->spill);
+        vfprintf(data->spill, assembly, args);
+        fputc('\n', data->spill);
+        va_end(args);
+        return;
+    }
+
+    // Find final length of formatted string
+    va_list argscopy;
+    va_copy(argscopy, args);
+
+    size_t formatted_length = (size_t) vsnprintf(NULL, 0, assembly, args) + 1;
+
+    char *line = arena_alloc(formatted_length * sizeof(char));
+    vsnprintf(line, formatted_length, assembly, argscopy);
+
+    LIST_APPEND(data->lines, data->size, data->capacity, const char *,
+                line);
+    LIST_APPEND(data->labels, data->label_size, data->label_capacity,
+                uint32_t, label);
+
+    va_end(args);
+    va_end(argscopy);
+
+    data->bytes += formatted_length;
+    if (data->spillable && (data->bytes > memory_budget / 2))
+    {
+        data->spill = tmpfile();
+        if (data->spill != NULL)
+        {
+            spill_lines(data->spill, "    ", data->lines, data->size);
+            data->size = 0;
+            data->label_size = 0;
+        }
+        // if the temp file could not be opened, keep buffering
+    }
+}
+
+void write_into_text(SectionText *text, const char *assembly, ...)
+{
+    va_list args; 
+    va_start(args, assembly); 
+
+    if (text->spill != NULL)
+    {
+        fputs("        ", text->spill);
+        vfprintf(text->spill, assembly, args);
+        fputc('\n', text->spill);
+        va_end(args);
+        return;
+    }
+
+    // Find final length of formatted string
+    va_list argscopy;
+    va_copy(argscopy, args);
+
+    size_t formatted_length = (size_t) vsnprintf(NULL, 0, assembly, args) + 1; 
+
+    char *line = arena_alloc(formatted_length * sizeof(char));
+    vsnprintf(line, formatted_length, assembly, argscopy);
+
+    LIST_APPEND(text->lines, text->size, text->capacity, const char *,
+                line);
+
+    va_end(args);
+    va_end(argscopy);
+
+    text->bytes += formatted_length;
+    if (text->spillable && (text->bytes > memory_budget / 2))
+    {
+        text->spill = tmpfile();
+        if (text->spill != NULL)
+        {
+            spill_lines(text->spill, "        ", text->lines, text->size);
+            text->size = 0;
+        }
+        // if the temp file could not be opened, keep buffering
+    }
+}
+
+/* Names the data-section label for a string literal. The name is a hash
+ * of the string's contents rather than a running counter, so the same
+ * sentence always produces the same label no matter where it sits in the
+ * file -- which is what lets cached fragments be reused across
+ * recompiles (see the fragment cache below). One FNV pass per
+ * occurrence, which `sentence_hash` pays over the same bytes anyway;
+ * the define-once filter in `write_into_data()` still guarantees a
+ * single `db` definition per distinct string however many sentences
+ * reference it.
+ */
+static uint32_t literal_label(InternId id)
+{
+    const char *contents = intern_string(id);
+    uint32_t h = fnv1a_update(FNV1A_SEED, contents, strlen(contents));
+    return h ? h : 1u;  // 0 means "no label" in SectionData
+}
+
+/* Formats one runtime-chain operand into `buffer`: an integer literal
+ * as an immediate, an integer variable as its storage. Anything else is
+ * a diagnostic (runtime arithmetic is integer-only today; floats either
+ * fold completely or are unimplemented).
+ */
+static bool np_operand(Token t, char *buffer, size_t size)
+{
+    if ((t.type == TOKEN_LITERAL) && (t.literal == LITERAL_INTEGER))
+    {
+        snprintf(buffer, size, "%lld", t.value.integer);
+        return true;
+    }
+    if (t.type == TOKEN_IDENTIFIER)
+    {
+        const char *name = intern_string(t.value.name);
+        Symbol *sym = symbol_lookup(t.value.name);
+        if (sym == NULL)
+        {
+            return false;  // reported by the symbol scan
+        }
+        if (sym->type != LITERAL_INTEGER)
+        {
+            diag_report(
+                0, 0,
+                "Unimplemented: runtime arithmetic on non-integer "
+                "variable '%s'.",
+                name);
+            return false;
+        }
+        snprintf(buffer, size, "dword [VARIABLE_%s]", name);
+        return true;
+    }
+    if ((t.type == TOKEN_LITERAL) && (t.literal == LITERAL_FLOAT))
+    {
+        diag_report(0, 0, "Unimplemented: runtime float arithmetic.");
+        return false;
+    }
+    diag_report(0, 0, "Invalid operand in expression.");
+    return false;
+}
+
+/* Emits instructions leaving a runtime chain's integer value in eax:
+ * one mov for the head, one add per preposition, left to right.
+ */
+static bool np_emit_eval(NounPhrase np, SectionText *text)
+{
+    char operand[80];
+    if (!np_operand(np.noun, operand, sizeof(operand)))
+    {
+        return false;
+    }
+    write_into_text(text, "mov     eax, %s", operand);
+    for (size_t i = 0; i < np.ppl.size; ++i)
+    {
+        if (!np_operand(np.ppl.list[i].np.noun, operand, sizeof(operand)))
+        {
+            return false;
+        }
+        write_into_text(text, "add     eax, %s", operand);
+    }
+    return true;
+}
+
+/* Inputs data retrieved from `Sentence` into provided `SectionData` and
+ * `SectionText` pointers by generating ASM.
+ */
+void compile_sentence(Sentence s, SectionData *data, SectionText *text)
+{
+    if (s.subj.noun.type == TOKEN_NULL)
+    {
+        // TODO: better error handling
+        if (s.pred.verb.type == TOKEN_NULL)
+        {
+            diag_report(0, 0, "Missing verb in sentence.");
+            return;
+            // else if (declarative) { error }
+            // could really be a nice succinct switch statement probably
+        }
+        else if (is_keyword((s.pred.verb), KEYWORD_SITELEN))
+        {
+            Token folded;
+            if ((s.pred.obj.noun.type == TOKEN_IDENTIFIER) &&
+                (s.pred.obj.ppl.size == 0))
+            {
+                const char *name =
+                    intern_string(s.pred.obj.noun.value.name);
+                Symbol *sym =
+                    symbol_lookup(s.pred.obj.noun.value.name);
+                if (sym == NULL)
+                {
+                    return;  // reported by the symbol scan
+                }
+
+                // The symbol's type picks the format and how the
+                // argument is passed: strings by address, numbers by
+                // value out of their storage
+                if (sym->type == LITERAL_STRING)
+                {
+                    write_into_text(text, "push    dword VARIABLE_%s",
+                                    name);
+                    write_into_text(text, "push    dword formatString");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 8");
+                }
+                else if (sym->type == LITERAL_INTEGER)
+                {
+                    write_into_text(text, "push    dword [VARIABLE_%s]",
+                                    name);
+                    write_into_text(text, "push    dword formatInteger");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 8");
+                }
+                else if (sym->type == LITERAL_FLOAT)
+                {
+                    // %f takes a double: push both dwords, high first
+                    write_into_text(text, "push    dword [VARIABLE_%s+4]",
+                                    name);
+                    write_into_text(text, "push    dword [VARIABLE_%s]",
+                                    name);
+                    write_into_text(text, "push    dword formatFloat");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 12");
+                }
+            }
+            else if (np_fold(s.pred.obj, &folded))
+            {
+                if (is_literal(folded, LITERAL_STRING))
+                {
+                    uint32_t label =
+                        literal_label(folded.value.string);
+
+                    // Generate data
+                    write_into_data(data, label,
+                                    "LITERAL_%08x db \"%s\", 0",
+                                    label,
+                                    intern_string(folded.value.string));
+
+                    // Generate text
+                    write_into_text(text, "push    dword LITERAL_%08x",
+                                    label);
+                    write_into_text(text, "push    dword formatString");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 8");
+                }
+                else if (is_literal(folded, LITERAL_INTEGER))
+                {
+                    write_into_text(text, "push    %d",
+                                    folded.value.integer);
+                    write_into_text(text, "push    dword formatInteger");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 8");
+                }
+                else if (is_literal(folded, LITERAL_FLOAT))
+                {
+                    write_into_text(text, "push    %d",
+                                    folded.value.floating);
+                    write_into_text(text, "push    dword formatFloat");
+                    write_into_text(text, "call    _printf");
+                    write_into_text(text, "add     esp, byte 8");
+                }
+                else
+                {
+                    diag_report(0, 0,
+                                "Incorrect object for verb 'sitelen'.");
+                    return;
+                }
+            }
+            else if (s.pred.obj.noun.type == TOKEN_NULL)
+            {
+                diag_report(0, 0, "Incorrect object for verb 'sitelen'.");
+                return;
+            }
+            else
+            {
+                // Runtime chain: evaluate into eax, print as integer
+                if (!np_emit_eval(s.pred.obj, text))
+                {
+                    return;
+                }
+                write_into_text(text, "push    eax");
+                write_into_text(text, "push    dword formatInteger");
+                write_into_text(text, "call    _printf");
+                write_into_text(text, "add     esp, byte 8");
+            }
+        }
+    }
+    else  // extant subject
+    {
+        if (s.pred.verb.type == TOKEN_NULL)
+        {
+            return;  // Do nothing, we have an lone NP
+        }
+        else if (is_keyword(s.pred.verb, KEYWORD_KAMA))
+        {
+            if (s.subj.noun.type != TOKEN_IDENTIFIER)
+            {
+                diag_report(0, 0, "Subject must be identifier in assignment.");
+                return;
+            }
+            if (s.pred.obj.noun.type == TOKEN_NULL)
+            {
+                diag_report(0, 0, "Assignment statement needs object.");
+                return;
+            }
+
+            // Generate data: a folded (fully-literal) object becomes an
+            // initialized definition; a runtime chain reserves storage
+            // and stores eax into it
+            Token folded;
+            if (np_fold(s.pred.obj, &folded))
+            {
+                if (is_literal(folded, LITERAL_STRING))
+                {
+                    write_into_data(
+                        data, 0, "VARIABLE_%s db \"%s\", 0",
+                        intern_string(s.subj.noun.value.name),
+                        intern_string(folded.value.string)
+                        );
+                }
+                else if (is_literal(folded, LITERAL_INTEGER))
+                {
+                    write_into_data(
+                        data, 0, "VARIABLE_%s dq %d",
+                        intern_string(s.subj.noun.value.name),
+                        folded.value.integer
+                        );
+                }
+                else if (is_literal(folded, LITERAL_FLOAT))
+                {
+                    write_into_data(
+                        data, 0, "VARIABLE_%s dq %f",
+                        intern_string(s.subj.noun.value.name),
+                        folded.value.floating
+                        );
+                }
+            }
+            else
+            {
+                write_into_data(
+                    data, 0, "VARIABLE_%s dq 0",
+                    intern_string(s.subj.noun.value.name)
+                    );
+                if (!np_emit_eval(s.pred.obj, text))
+                {
+                    return;
+                }
+                write_into_text(text, "mov     [VARIABLE_%s], eax",
+                                intern_string(s.subj.noun.value.name));
+            }
+        }
+    }
+}
+
+
+/* The fragment cache makes recompiles incremental at sentence
+ * granularity. Codegen output is captured per sentence as a `Fragment`
+ * (its data and text lines), keyed by a content hash of the sentence's
+ * tokens, and the fragments are persisted to a `.tokicache` file next to
+ * the output. On the next compile, any sentence whose hash is already in
+ * the cache splices its stored lines straight into the sections and
+ * skips codegen entirely, so edits only pay for the sentences they
+ * touched. Hashes cover token *contents* (interned spellings, literal
+ * values), never positions or InternIds, and literal labels are content
+ * hashes too (`literal_label()`), so a fragment is valid wherever the
+ * sentence moves to.
+ */
+
+typedef struct Fragment
+{
+    uint32_t hash;
+    SectionData data;
+    SectionText text;
+} Fragment;
+
+#define FRAGMENT_EMPTY ((size_t) -1)
+
+typedef struct FragmentCache
+{
+    Fragment *list;
+    size_t size;
+    size_t capacity;
+    // open-addressed index: probe by hash, slots hold indices into
+    // `list` (or FRAGMENT_EMPTY)
+    size_t *slots;
+    size_t slot_count;
+} FragmentCache;
+
+#define FRAGMENTCACHE_DEFAULT ((FragmentCache) {\
+    .list = NULL, .size = 0, .capacity = 0,\
+    .slots = NULL, .slot_count = 0\
+})
+
+#define CACHE_MAGIC "toki fragment cache v1"
+
+/* Content hash of one token: its type, and its value by *contents* --
+ * interned spellings are hashed as bytes so the hash survives across
+ * runs, where InternIds would not.
+ */
+static uint32_t token_hash(uint32_t h, Token t)
+{
+    h = fnv1a_update(h, &t.type, sizeof(t.type));
+    h = fnv1a_update(h, &t.literal, sizeof(t.literal));
+    switch (t.type)
+    {
+        case TOKEN_KEYWORD:
+            h = fnv1a_update(h, &t.value.keyword, sizeof(t.value.keyword));
+            break;
+        case TOKEN_SEPARATOR:
+            h = fnv1a_update(h, &t.value.separator,
+                             sizeof(t.value.separator));
+            break;
+        case TOKEN_IDENTIFIER:
+        {
+            const char *name = intern_string(t.value.name);
+            h = fnv1a_update(h, name, strlen(name));
+            // Codegen for an identifier depends on the variable's type,
+            // so the fragment hash must too (the pre-pass defines
+            // symbols in sentence order before hashing the reference)
+            Symbol *sym = symbol_lookup(t.value.name);
+            int type = (sym != NULL) ? (int) sym->type : -1;
+            h = fnv1a_update(h, &type, sizeof(type));
+            break;
+        }
+        case TOKEN_LITERAL:
+            if (t.literal == LITERAL_STRING)
+            {
+                const char *contents = intern_string(t.value.string);
+                h = fnv1a_update(h, contents, strlen(contents));
+            }
+            else
+            {
+                h = fnv1a_update(h, &t.value, sizeof(t.value));
+            }
+            break;
+        default:
+            break;
+    }
+    return h;
+}
+
+static uint32_t modlist_hash(uint32_t h, const ModifierList *l)
+{
+    h = fnv1a_update(h, &l->size, sizeof(l->size));
+    for (size_t i = 0; i < l->size; ++i)
+    {
+        h = token_hash(h, modlist_get(l, i));
+    }
+    return h;
+}
+
+static uint32_t nounphrase_hash(uint32_t h, NounPhrase np)
+{
+    h = token_hash(h, np.noun);
+    h = modlist_hash(h, &np.adjp);
+    h = fnv1a_update(h, &np.ppl.size, sizeof(np.ppl.size));
+    for (size_t i = 0; i < np.ppl.size; ++i)
+    {
+        h = token_hash(h, np.ppl.list[i].prep);
+        h = token_hash(h, np.ppl.list[i].np.noun);
+        h = modlist_hash(h, &np.ppl.list[i].np.adjp);
+    }
+    return h;
+}
+
+uint32_t sentence_hash(Sentence s)
+{
+    uint32_t h = FNV1A_SEED;
+    h = nounphrase_hash(h, s.subj);
+    h = token_hash(h, s.pred.verb);
+    h = modlist_hash(h, &s.pred.advp);
+    h = nounphrase_hash(h, s.pred.obj);
+    return h ? h : 1u;
+}
+
+static char *cache_path(const char *outfile)
+{
+    char *fname = malloc(strlen(outfile) + sizeof(".tokicache"));
+    strcpy(fname, outfile);
+    strcat(fname, ".tokicache");
+    return fname;
+}
+
+/* Probes the index for a fragment with this sentence hash; NULL on a
+ * miss. (A 32-bit collision between two different sentences would reuse
+ * the wrong fragment -- vanishingly unlikely at source-file scale, and
+ * deleting the cache file recovers.)
+ */
+const Fragment *cache_lookup(const FragmentCache *cache, uint32_t hash)
+{
+    if (cache->slot_count == 0)
+    {
+        return NULL;
+    }
+    size_t i = hash % cache->slot_count;
+    while (cache->slots[i] != FRAGMENT_EMPTY)
+    {
+        if (cache->list[cache->slots[i]].hash == hash)
+        {
+            return &cache->list[cache->slots[i]];
+        }
+        i = (i + 1) % cache->slot_count;
+    }
+    return NULL;
+}
+
+/* Takes the next newline-terminated line out of the loaded cache buffer,
+ * NUL-terminating it in place; NULL once the buffer is exhausted.
+ */
+static char *cache_next_line(char **p)
+{
+    char *line = *p;
+    if ((line == NULL) || (*line == '\0'))
+    {
+        return NULL;
+    }
+    char *nl = strchr(line, '\n');
+    if (nl != NULL)
+    {
+        *nl = '\0';
+        *p = nl + 1;
+    }
+    else
+    {
+        *p = line + strlen(line);
+    }
+    return line;
+}
+
+/* Loads the cache file written by the previous compile of `outfile`, if
+ * one exists. The format is line-oriented:
+ *     toki fragment cache v1
+ *     S <sentence hash> <data lines> <text lines>
+ *     D <label> <line>   (one per data line; label 0 = unlabelled)
+ *     T <line>           (one per text line)
+ * A missing, stale-versioned or malformed file just means fewer hits --
+ * parsing stops at the first line it does not understand.
+ */
+void cache_load(FragmentCache *cache, const char *outfile)
+{
+    *cache = FRAGMENTCACHE_DEFAULT;
+
+    char *fname = cache_path(outfile);
+    FILE *fptr = fopen(fname, "r");
+    free(fname);
+    if (fptr == NULL)
+    {
+        return;
+    }
+
+    fseek(fptr, 0, SEEK_END);
+    long length = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+    if (length <= 0)
+    {
+        fclose(fptr);
+        return;
+    }
+    char *buffer = arena_alloc((size_t) length + 1);
+    size_t got = fread(buffer, 1, (size_t) length, fptr);
+    buffer[got] = '\0';
+    fclose(fptr);
+
+    // Split into lines in place; fragment lines point into this buffer
+    char *p = buffer;
+    char *line = cache_next_line(&p);
+    if ((line == NULL) || strcmp(line, CACHE_MAGIC))
+    {
+        return;
+    }
+
+    while ((line = cache_next_line(&p)) != NULL)
+    {
+        Fragment frag;
+        frag.data = SECTIONDATA_DEFAULT;
+        frag.text = SECTIONTEXT_DEFAULT;
+        size_t data_count;
+        size_t text_count;
+        if (sscanf(line, "S %x %zu %zu",
+                   &frag.hash, &data_count, &text_count) != 3)
+        {
+            break;
+        }
+
+        bool ok = true;
+        for (size_t i = 0; ok && (i < data_count); ++i)
+        {
+            line = cache_next_line(&p);
+            char *rest;
+            if ((line == NULL) || (line[0] != 'D') ||
+                (line[1] != ' '))
+            {
+                ok = false;
+                break;
+            }
+            uint32_t label = (uint32_t) strtoul(line + 2, &rest, 16);
+            if (*rest != ' ')
+            {
+                ok = false;
+                break;
+            }
+            LIST_APPEND(frag.data.lines, frag.data.size,
+                        frag.data.capacity, const char *, rest + 1);
+            LIST_APPEND(frag.data.labels, frag.data.label_size,
+                        frag.data.label_capacity, uint32_t, label);
+        }
+        for (size_t i = 0; ok && (i < text_count); ++i)
+        {
+            line = cache_next_line(&p);
+            if ((line == NULL) || (line[0] != 'T') || (line[1] != ' '))
+            {
+                ok = false;
+                break;
+            }
+            LIST_APPEND(frag.text.lines, frag.text.size,
+                        frag.text.capacity, const char *, line + 2);
+        }
+        if (!ok)
+        {
+            break;
+        }
+
+        LIST_APPEND(cache->list, cache->size, cache->capacity, Fragment,
+                    frag);
+    }
+
+    // Build the probe index (first fragment wins on equal hashes)
+    cache->slot_count = cache->size * 2 + 16;
+    cache->slots = arena_alloc(cache->slot_count * sizeof(size_t));
+    for (size_t i = 0; i < cache->slot_count; ++i)
+    {
+        cache->slots[i] = FRAGMENT_EMPTY;
+    }
+    for (size_t f = 0; f < cache->size; ++f)
+    {
+        size_t i = cache->list[f].hash % cache->slot_count;
+        while ((cache->slots[i] != FRAGMENT_EMPTY) &&
+               (cache->list[cache->slots[i]].hash != cache->list[f].hash))
+        {
+            i = (i + 1) % cache->slot_count;
+        }
+        if (cache->slots[i] == FRAGMENT_EMPTY)
+        {
+            cache->slots[i] = f;
+        }
+    }
+}
+
+/* Persists this run's fragments next to the output. Best-effort: an
+ * unwritable cache file costs nothing but the next compile's speed.
+ */
+void cache_save(const char *outfile, const FragmentCache *run)
+{
+    char *fname = cache_path(outfile);
+    FILE *fptr = fopen(fname, "w");
+    free(fname);
+    if (fptr == NULL)
+    {
+        return;
+    }
+
+    fprintf(fptr, "%s\n", CACHE_MAGIC);
+    for (size_t f = 0; f < run->size; ++f)
+    {
+        const Fragment *frag = &run->list[f];
+        fprintf(fptr, "S %08x %zu %zu\n",
+                frag->hash, frag->data.size, frag->text.size);
+        for (size_t i = 0; i < frag->data.size; ++i)
+        {
+            fprintf(fptr, "D %x %s\n",
+                    frag->data.labels[i], frag->data.lines[i]);
+        }
+        for (size_t i = 0; i < frag->text.size; ++i)
+        {
+            fprintf(fptr, "T %s\n", frag->text.lines[i]);
+        }
+    }
+    fclose(fptr);
+}
+
+/* Appends a fragment's lines to the real output sections. Labelled data
+ * lines go through the same define-once filter as fresh codegen, so a
+ * literal already defined by an earlier sentence is not redefined by a
+ * cached one.
+ */
+void fragment_splice(const Fragment *frag, SectionData *sd, SectionText *st)
+{
+    for (size_t i = 0; i < frag->data.size; ++i)
+    {
+        uint32_t label = frag->data.labels[i];
+        if ((label != 0) && !u32set_add(&sd->emitted, label))
+        {
+            continue;
+        }
+        LIST_APPEND(sd->lines, sd->size, sd->capacity, const char *,
+                    frag->data.lines[i]);
+        LIST_APPEND(sd->labels, sd->label_size, sd->label_capacity,
+                    uint32_t, label);
+    }
+    for (size_t i = 0; i < frag->text.size; ++i)
+    {
+        LIST_APPEND(st->lines, st->size, st->capacity, const char *,
+                    frag->text.lines[i]);
+    }
+}
+
+/* Emits the deferred stack adjustment accumulated by `peephole_text()`
+ * as a single `add esp`. NASM only takes the `byte` hint for immediates
+ * that fit a signed byte.
+ */
+static size_t peephole_flush(SectionText *st, size_t out, long pending)
+{
+    if (pending == 0)
+    {
+        return out;
+    }
+    char *line = arena_alloc(32);
+    if (pending <= 127)
+    {
+        sprintf(line, "add     esp, byte %ld", pending);
+    }
+    else
+    {
+        sprintf(line, "add     esp, %ld", pending);
+    }
+    st->lines[out] = line;
+    return out + 1;
+}
+
+/* Peephole pass over the merged .text lines, run once all fragments are
+ * spliced and before rendering. printf is cdecl -- the caller owns the
+ * stack cleanup -- so the cleanup can be deferred across a run of
+ * consecutive calls: each per-call `add esp, byte N` is dropped and its
+ * adjustment accumulated, and one combined add is emitted before the
+ * first instruction that is not part of a push/call run (or before the
+ * final ret). A program of 10k prints keeps one stack adjustment
+ * instead of 10k. The deferred run is capped so an arbitrarily long
+ * print sequence cannot grow the stack past the platform's guard page.
+ * Rewrites the line buffer in place; fragments still hold the
+ * unoptimized per-sentence lines, so the cache is unaffected.
+ */
+#define PEEPHOLE_ESP_CAP 4096
+
+void peephole_text(SectionText *st)
+{
+    static const char ADD_ESP[] = "add     esp, byte ";
+    size_t out = 0;
+    long pending = 0;
+    for (size_t i = 0; i < st->size; ++i)
+    {
+        const char *line = st->lines[i];
+        if (strncmp(line, ADD_ESP, sizeof(ADD_ESP) - 1) == 0)
+        {
+            pending += strtol(line + sizeof(ADD_ESP) - 1, NULL, 10);
+            if (pending >= PEEPHOLE_ESP_CAP)
+            {
+                // A dropped add is a point where no arguments are
+                // live, so the combined adjustment can land here
+                out = peephole_flush(st, out, pending);
+                pending = 0;
+            }
+            continue;
+        }
+        if ((strncmp(line, "push", 4) != 0) &&
+            (strncmp(line, "call", 4) != 0))
+        {
+            out = peephole_flush(st, out, pending);
+            pending = 0;
+        }
+        st->lines[out++] = line;
+    }
+    st->size = peephole_flush(st, out, pending);
+}
+
+/* Renders the two sections into a single contiguous buffer of assembly
+ * text. The buffer is sized up front from the section line lengths, so
+ * rendering is one pass of memcpys with no reallocation. Returns the
+ * buffer (arena-owned) and stores its length in `*out_len`.
+ */
+// opening boilerplate
+static const char PROLOGUE[] =
+    "    global _main\n"
+    "    extern _printf\n\n"
+    "section .text\n"
+    "    _main:\n";
+
+// end .text boilerplate
+static const char TEXT_EPILOGUE[] =
+    "        ret\n\n";
+
+// .data boilerplate
+static const char DATA_PROLOGUE[] =
+    "section .data\n"
+    "    formatString db \"%s\", 10, 0\n"
+    "    formatInteger db \"%d\", 10, 0\n"
+    "    formatFloat db \"%f\", 10, 0\n";
+
+char *render_asm(const SectionData *sd, const SectionText *st,
+                 size_t *out_len)
+{
+    // Pre-size the buffer: boilerplate, plus every line with its
+    // indentation and newline
+    size_t capacity = (sizeof(PROLOGUE) - 1) +
+                      (sizeof(TEXT_EPILOGUE) - 1) +
+                      (sizeof(DATA_PROLOGUE) - 1);
+    for (int i = 0; i < st->size; ++i)
+    {
+        capacity += 8 + strlen(st->lines[i]) + 1;
+    }
+    for (int i = 0; i < sd->size; ++i)
+    {
+        capacity += 4 + strlen(sd->lines[i]) + 1;
+    }
+
+    char *buffer = arena_alloc(capacity);
+    char *p = buffer;
+
+    memcpy(p, PROLOGUE, sizeof(PROLOGUE) - 1);
+    p += sizeof(PROLOGUE) - 1;
+
+    // _main:
+    for (int i = 0; i < st->size; ++i)
+    {
+        memcpy(p, "        ", 8);
+        p += 8;
+        size_t n = strlen(st->lines[i]);
+        memcpy(p, st->lines[i], n);
+        p += n;
+        *p++ = '\n';
+    }
+
+    memcpy(p, TEXT_EPILOGUE, sizeof(TEXT_EPILOGUE) - 1);
+    p += sizeof(TEXT_EPILOGUE) - 1;
+    memcpy(p, DATA_PROLOGUE, sizeof(DATA_PROLOGUE) - 1);
+    p += sizeof(DATA_PROLOGUE) - 1;
+
+    // .data:
+    for (int i = 0; i < sd->size; ++i)
+    {
+        memcpy(p, "    ", 4);
+        p += 4;
+        size_t n = strlen(sd->lines[i]);
+        memcpy(p, sd->lines[i], n);
+        p += n;
+        *p++ = '\n';
+    }
+
+    *out_len = p - buffer;
+    return buffer;
+}
+
+/* Copies a rewound spill file into the output stream.
+ */
+static void copy_spill(FILE *dst, FILE *spill)
+{
+    static char buf[1 << 16];
+    rewind(spill);
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), spill)) > 0)
+    {
+        fwrite(buf, 1, n, dst);
+    }
+}
+
+/* Writes the rendered assembly into an open stream -- either the `.asm`
+ * output file or the pipe to the assembler -- as one fwrite. A section
+ * that spilled under a memory budget is instead streamed: the spilled
+ * lines are byte-copied from the temp file, followed by whatever tail
+ * is still in memory, in the same fixed section order.
+ */
+void emit_asm(FILE *fptr, const SectionData *sd, const SectionText *st)
+{
+    if ((sd->spill == NULL) && (st->spill == NULL))
+    {
+        size_t len;
+        const char *text = render_asm(sd, st, &len);
+        fwrite(text, 1, len, fptr);
+        return;
+    }
+
+    fputs(PROLOGUE, fptr);
+    if (st->spill != NULL)
+    {
+        copy_spill(fptr, st->spill);
+    }
+    for (size_t i = 0; i < st->size; ++i)
+    {
+        fputs("        ", fptr);
+        fputs(st->lines[i], fptr);
+        fputc('\n', fptr);
+    }
+    fputs(TEXT_EPILOGUE, fptr);
+    fputs(DATA_PROLOGUE, fptr);
+    if (sd->spill != NULL)
+    {
+        copy_spill(fptr, sd->spill);
+    }
+    for (size_t i = 0; i < sd->size; ++i)
+    {
+        fputs("    ", fptr);
+        fputs(sd->lines[i], fptr);
+        fputc('\n', fptr);
+    }
+}
+
+/* Writes data from `SectionData` and `SectionText` into an assembly file.
+ */
+void write_asm(const char *outfile, const SectionData *sd, const SectionText *st)
+{
+    char *fname = malloc(80 * sizeof(char));
+    strcpy(fname, outfile);
+    strcat(fname, ".asm");
+
+    FILE *fptr = fopen(fname, "w");
+
+    if (fptr == NULL)
+    {
+        fprintf(
+            stderr,
+            "Failed to create ASM file.\n"
+            "  %s",
+            strerror(errno));
+
+        exit(-1);
+    }
+
+    emit_asm(fptr, sd, st);
+
+    fclose(fptr);
+}
+
+/* The command that links the assembled object into the final
+ * executable. The default goes through the gcc driver, which is
+ * portable but drags the whole driver in just to link one object
+ * against the CRT; `--linker` swaps in a direct linker invocation
+ * (e.g. "ld %s.obj -o %s -lmsvcrt" with the right library path) for
+ * build farms where the driver dominates link time. Both %s receive the
+ * output base name.
+ */
+static const char *link_command = "gcc %s.obj -o %s";
+
+/* Makes the generated sections into an `.exe`. By default the assembly is
+ * fed to nasm over a pipe (see ASSEMBLE_VIA_PIPE), so the `.obj` is the
+ * only intermediate that touches disk; the `.asm` file round trip is the
+ * fallback. Linking goes through `link_command`.
+ */
+void make(const char *outfile, const SectionData *sd, const SectionText *st)
+{
+    bool assembled = false;
+
+#if ASSEMBLE_VIA_PIPE
+#ifndef _WIN32
+    // If nasm dies (or was never there), keep running and fall back to
+    // the file path instead of taking a SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    char *cmd0 = malloc(strlen("nasm -f win32 -o .obj -") +
+                        strlen(outfile) + 1);
+    sprintf(cmd0, "nasm -f win32 -o %s.obj -", outfile);
+    double pipe_start = profile_wall();
+    FILE *pipe = popen(cmd0, "w");
+    if (pipe != NULL)
+    {
+        emit_asm(pipe, sd, st);
+        assembled = (pclose(pipe) == 0);
+    }
+    profile.assemble_wall += profile_wall() - pipe_start;
+    free(cmd0);
+#endif
+
+    if (!assembled)
+    {
+        write_asm(outfile, sd, st);
+        char *cmd1 = malloc(80 * sizeof(const char));
+        sprintf(cmd1, "nasm -f win32 %s.asm", outfile);
+        double nasm_start = profile_wall();
+        system(cmd1);
+        profile.assemble_wall += profile_wall() - nasm_start;
+        free(cmd1);
+    }
+
+    char *cmd2 = malloc(strlen(link_command) + 2 * strlen(outfile) + 1);
+    sprintf(cmd2, link_command, outfile, outfile);
+    double link_start = profile_wall();
+    system(cmd2);
+    profile.assemble_wall += profile_wall() - link_start;
+    free(cmd2);
+
+#if DELETE_INTERMEDIATE
+    char *cmd3 = malloc(80 * sizeof(const char));
+    char *cmd4 = malloc(80 * sizeof(const char));
+    sprintf(cmd3, "del %s.asm", outfile);
+    sprintf(cmd4, "del %s.obj", outfile);
+    system(cmd3);
+    system(cmd4);
+    free(cmd3);
+    free(cmd4);
+#endif
+}
+
+/* Allocates and zeroes the two output sections.
+ */
+void sections_init(SectionData **sd, SectionText **st)
+{
+    *sd = arena_alloc(sizeof(SectionData));
+    **sd = SECTIONDATA_DEFAULT;
+    *st = arena_alloc(sizeof(SectionText));
+    **st = SECTIONTEXT_DEFAULT;
+}
+
+/* Number of codegen worker threads (the --jobs flag); 1 keeps codegen
+ * on the main thread.
+ */
+static int codegen_jobs = 1;
+
+#ifndef _WIN32
+
+typedef struct CodegenTask
+{
+    SentenceList input;
+    Fragment *frags;
+    const bool *needs_codegen;
+    int worker;
+    int workers;
+} CodegenTask;
+
+/* One codegen worker: compiles every `workers`-th cache-missed sentence
+ * into its pre-assigned fragment slot. Fragments are slot-addressed and
+ * literal labels are content hashes, so workers share nothing but the
+ * read-only sentences and intern table; each allocates from its own
+ * thread-local arena and returns the chain for the main thread to
+ * adopt.
+ */
+static void *codegen_worker(void *arg)
+{
+    CodegenTask *task = arg;
+    for (size_t i = (size_t) task->worker; i < task->input.size;
+         i += (size_t) task->workers)
+    {
+        if (task->needs_codegen[i])
+        {
+            compile_sentence(task->input.list[i],
+                             &task->frags[i].data,
+                             &task->frags[i].text);
+        }
+    }
+    profile_adopt_arena();
+    return arena_detach();
+}
+
+#endif  // !_WIN32
+
+/* Compiles every sentence and makes the result into an executable.
+ * Codegen runs through the fragment cache: each sentence is either
+ * reused from the previous compile or compiled fresh into its own
+ * fragment, and the fragments are spliced into the sections in sentence
+ * order -- output is byte-identical either way. With --jobs N the
+ * cache-missed fragments are compiled by N worker threads instead of a
+ * serial loop; the slot-per-sentence layout makes the ordering (and so
+ * the output) deterministic regardless of worker interleaving.
+ */
+void compile(const char *outfile, SentenceList input)
+{
+    double codegen_start = profile_wall();
+
+    SectionData *sd;
+    SectionText *st;
+    sections_init(&sd, &st);
+
+    FragmentCache cache;
+    cache_load(&cache, outfile);
+    FragmentCache run = FRAGMENTCACHE_DEFAULT;
+
+    Fragment *frags = arena_alloc(input.size * sizeof(Fragment));
+    bool *needs_codegen = arena_alloc(input.size * sizeof(bool));
+    size_t misses = 0;
+
+    // The symbol table must be complete before anything is hashed:
+    // codegen consults the full table, so a hash taken against the
+    // half-built one would miss a forward reference's type and let a
+    // later type change reuse a stale cached fragment
+    for (size_t i = 0; i < input.size; ++i)
+    {
+        symbol_scan_sentence(input.list[i]);
+    }
+
+    for (size_t i = 0; i < input.size; ++i)
+    {
+        uint32_t hash = sentence_hash(input.list[i]);
+        const Fragment *hit = cache_lookup(&cache, hash);
+        if (hit != NULL)
+        {
+            frags[i] = *hit;
+            needs_codegen[i] = false;
+        }
+        else
+        {
+            frags[i].hash = hash;
+            frags[i].data = SECTIONDATA_DEFAULT;
+            frags[i].text = SECTIONTEXT_DEFAULT;
+            needs_codegen[i] = true;
+            ++misses;
+        }
+    }
+
+#ifndef _WIN32
+    if ((codegen_jobs > 1) && (misses > 1))
+    {
+        int workers = codegen_jobs;
+        if ((size_t) workers > misses)
+        {
+            workers = (int) misses;
+        }
+        pthread_t *threads = arena_alloc(workers * sizeof(pthread_t));
+        CodegenTask *tasks = arena_alloc(workers * sizeof(CodegenTask));
+        for (int w = 0; w < workers; ++w)
+        {
+            tasks[w] = (CodegenTask) {
+                .input = input,
+                .frags = frags,
+                .needs_codegen = needs_codegen,
+                .worker = w,
+                .workers = workers};
+            pthread_create(&threads[w], NULL, codegen_worker, &tasks[w]);
+        }
+        for (int w = 0; w < workers; ++w)
+        {
+            void *chain;
+            pthread_join(threads[w], &chain);
+            arena_adopt(chain);
+        }
+    }
+    else
+#endif
+    {
+        for (size_t i = 0; i < input.size; ++i)
+        {
+            if (needs_codegen[i])
+            {
+                compile_sentence(input.list[i],
+                                 &frags[i].data, &frags[i].text);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < input.size; ++i)
+    {
+        fragment_splice(&frags[i], sd, st);
+        LIST_APPEND(run.list, run.size, run.capacity, Fragment, frags[i]);
+    }
+
+    // An errored compile neither updates the fragment cache (a bad
+    // sentence must not be cached as an empty fragment) nor runs the
+    // toolchain
+    if (diagnostics.size == 0)
+    {
+        cache_save(outfile, &run);
+        peephole_text(st);
+        profile.codegen_wall += profile_wall() - codegen_start;
+        make(outfile, sd, st);
+    }
+    else
+    {
+        profile.codegen_wall += profile_wall() - codegen_start;
+    }
+}
+
+
+// MAIN
+
+// BENCHMARKING
+
+/* Built with `make toki-bench` (which defines TOKI_BENCH), this replaces
+ * the compiler's entry point with a benchmark driver:
+ *     toki-bench [shape] [sentences]
+ * It generates a synthetic program of the requested shape and sentence
+ * count in memory, runs each pipeline stage over it, and reports
+ * per-stage wall time with bytes/sec and tokens/sec. Shapes stress
+ * different parts of the pipeline:
+ *     string  string-literal sitelen sentences (interning, data section)
+ *     ident   distinct-identifier assignments (intern table growth)
+ *     adjp    long adjective chains (the parser's adjp buffers)
+ * Codegen is timed up to the rendered assembly buffer; nasm and the
+ * linker are deliberately left out so the numbers measure the compiler,
+ * not the toolchain.
+ */
+#ifdef TOKI_BENCH
+
+/* Appends one synthetic sentence of the given shape to the buffer.
+ */
+static void bench_sentence(const char *shape, size_t n,
+                           char **buffer, size_t *size, size_t *capacity)
+{
+    char line[256];
+    int length;
+    if (!strcmp(shape, "ident"))
+    {
+        length = snprintf(line, sizeof(line),
+                          "nimi%zu li kama e %zu.\n", n, n % 1000);
+    }
+    else if (!strcmp(shape, "adjp"))
+    {
+        length = snprintf(line, sizeof(line),
+                          "nimi%zu", n);
+        for (int adj = 0; adj < 12; ++adj)
+        {
+            length += snprintf(line + length, sizeof(line) - length,
+                               " lili%d", adj);
+        }
+        length += snprintf(line + length, sizeof(line) - length,
+                           " li kama e %zu.\n", n % 1000);
+    }
+    else  // string
+    {
+        length = snprintf(line, sizeof(line),
+                          "o sitelen e \"toki %zu\".\n", n % 4096);
+    }
+
+    while (*size + (size_t) length + 1 > *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : (1 << 16);
+        *buffer = realloc(*buffer, *capacity);
+    }
+    memcpy(*buffer + *size, line, (size_t) length);
+    *size += (size_t) length;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *shape = (argc >= 2) ? argv[1] : "string";
+    size_t sentences = (argc >= 3) ? strtoull(argv[2], NULL, 10) : 100000;
+
+    // Start with a real buffer so a zero-sentence run still has
+    // something to terminate and time
+    size_t capacity = 64;
+    char *source = malloc(capacity);
+    size_t length = 0;
+    for (size_t n = 0; n < sentences; ++n)
+    {
+        bench_sentence(shape, n, &source, &length, &capacity);
+    }
+    source[length] = '\0';
+
+    printf("shape %s, %zu sentences, %zu bytes\n",
+           shape, sentences, length);
+
+    // scan and evaluate are fused into tokenize(), so they are timed as
+    // one stage
+    double t0 = profile_wall();
+    TokenList tokens = tokenize(source, length);
+    double t1 = profile_wall();
+    SentenceList parsed = parse(tokens);
+    double t2 = profile_wall();
+
+    SectionData *sd;
+    SectionText *st;
+    sections_init(&sd, &st);
+    for (size_t i = 0; i < parsed.size; ++i)
+    {
+        compile_sentence(parsed.list[i], sd, st);
+    }
+    size_t asm_length;
+    render_asm(sd, st, &asm_length);
+    double t3 = profile_wall();
+
+    printf("%-10s %10s %14s %14s\n",
+           "stage", "ms", "bytes/sec", "tokens/sec");
+    printf("%-10s %10.2f %14.0f %14.0f\n",
+           "tokenize", (t1 - t0) * 1e3,
+           length / (t1 - t0), tokens.size / (t1 - t0));
+    printf("%-10s %10.2f %14s %14.0f\n",
+           "parse", (t2 - t1) * 1e3,
+           "-", tokens.size / (t2 - t1));
+    printf("%-10s %10.2f %14.0f %14.0f\n",
+           "compile", (t3 - t2) * 1e3,
+           asm_length / (t3 - t2), tokens.size / (t3 - t2));
+    printf("%-10s %10.2f %14.0f %14.0f\n",
+           "total", (t3 - t0) * 1e3,
+           length / (t3 - t0), tokens.size / (t3 - t0));
+
+    free(source);
+    intern_reset();
+    arena_reset();
+    return 0;
+}
+
+#endif  // TOKI_BENCH
+
+
+#ifndef TOKI_BENCH
+
+/* Compiles a single source file into `outfname`, resetting the arena and
+ * the intern table afterwards so the next file starts clean. Shared by
+ * the single-file and batch entry points. Returns 0 on success, -1 if
+ * any diagnostics were reported (all of them are printed in one batch).
+ */
+int compile_file(const char *fname, const char *outfname)
+{
+    profile_begin();
+    double total_start = profile_wall();
+    double cpu_start = profile_cpu();
+
+    // "-" streams from stdin in fixed-size chunks instead of slurping
+    if (!strcmp(fname, "-"))
+    {
+        double scan_start = profile_wall();
+        TokenList tokens = tokenize_stream(stdin);
+        profile.scan_wall = profile_wall() - scan_start;
+        profile.tokens = tokens.size;
+
+        double parse_start = profile_wall();
+        SentenceList sentences = parse(tokens);
+        profile.parse_wall = profile_wall() - parse_start;
+        profile.sentences = sentences.size;
+
+        compile(outfname, sentences);
+
+        profile.total_wall = profile_wall() - total_start;
+        profile.total_cpu = profile_cpu() - cpu_start;
+        if (profile.enabled)
+        {
+            profile_report();
+        }
+
+        int status = diag_flush() ? -1 : 0;
+        intern_reset();
+        symbol_reset();
+        arena_reset();
+        return status;
+    }
+
+    SourceFile source = {.text = NULL, .length = 0, .mapped = false};
+    SourceFile token_mapping;
+    TokenList tokens;
+
+    double scan_start = profile_wall();
+    if (!token_cache_load(fname, &tokens, &token_mapping))
+    {
+        source = read_source(fname);
+        tokens = tokenize(source.text, source.length);
+        // An errored scan does not update the cache: the surviving
+        // tokens alone would make the same broken source "compile"
+        // from a warm cache without re-reporting the errors
+        if (diagnostics.size == 0)
         {
-            buffer.list[buffer.size] = *p;
-            ++buffer.size;
+            token_cache_save(fname, tokens);
         }
-
-        ++p;  // Go to next Token
     }
+    profile.scan_wall = profile_wall() - scan_start;
+    profile.tokens = tokens.size;
+
+    double parse_start = profile_wall();
+    SentenceList sentences = parse(tokens);
+    profile.parse_wall = profile_wall() - parse_start;
+    profile.sentences = sentences.size;
+
+    compile(outfname, sentences);
 
-    if (buffer.list != NULL)
+    profile.total_wall = profile_wall() - total_start;
+    profile.total_cpu = profile_cpu() - cpu_start;
+    if (profile.enabled)
     {
-        free(buffer.list);
+        profile_report();
     }
 
-    return (SentenceList) {
-        .list = sl,
-        .size = size};
+    int status = diag_flush() ? -1 : 0;
+    intern_reset();
+    symbol_reset();
+    arena_reset();
+    release_source(source);
+    release_source(token_mapping);
+    return status;
 }
 
-
-// COMPILING
-
-/* These are helper functions which help significantly reduce the necessary code
- * for inputing lines of ASM into `SectionData` and `SectionText`.
+/* Pipelined execution: the scanner, parser and codegen run in lockstep
+ * over a single pass of the input. Each Token is handed to the parser as
+ * soon as it is scanned and each Sentence is compiled the moment its
+ * period arrives, so no whole-program TokenList or SentenceList is ever
+ * materialized and codegen overlaps the scan instead of waiting for it.
+ * Output is byte-identical to the staged path: both run the symbol scan
+ * over sentences in source order, so they agree that a variable must be
+ * defined before the sentence that reads it.
  */
-void write_into_data(SectionData *data, const char *assembly, ...)
+int compile_file_pipelined(const char *fname, const char *outfname)
 {
-    // Find final length of formatted string
-    va_list args; 
-    va_list argscopy;
-    va_start(args, assembly); 
-    va_copy(argscopy, args);
+    profile_begin();
+    double total_start = profile_wall();
+    double cpu_start = profile_cpu();
 
-    size_t formatted_length = (size_t) vsnprintf(NULL, 0, assembly, args) + 1; 
+    SourceFile source = read_source(fname);
 
-    char *line = malloc(formatted_length * sizeof(char));
-    vsnprintf(line, formatted_length, assembly, argscopy);
+    if (!CHAR_CLASS_BUILT)
+    {
+        build_char_class();
+    }
 
-    data->lines[data->size++] = line;
+    Parser parser;
+    parser_init(&parser);
 
-    va_end(args);
-    va_end(argscopy);
-}
+    SectionData *sd;
+    SectionText *st;
+    sections_init(&sd, &st);
+    if (memory_budget != 0)
+    {
+        sd->spillable = true;
+        st->spillable = true;
+    }
 
-void write_into_text(SectionText *text, const char *assembly, ...)
-{
-    // Find final length of formatted string
-    va_list args; 
-    va_list argscopy;
-    va_start(args, assembly); 
-    va_copy(argscopy, args);
+    const char *p = source.text;
+    const char *end = p + source.length;
 
-    size_t formatted_length = (size_t) vsnprintf(NULL, 0, assembly, args) + 1; 
+    while (p < end)
+    {
+        if (char_is(*p, CC_SPACE))
+        {
+#ifdef __SSE2__
+            p = skip_space(p, end);
+#else
+            ++p;
+#endif
+            continue;
+        }
 
-    char *line = malloc(formatted_length * sizeof(char));
-    vsnprintf(line, formatted_length, assembly, argscopy);
+        Token curr;
+        p = scan_token(p, end, true, source.text, 1, &curr);
+        if (curr.type == TOKEN_NULL)
+        {
+            continue;  // scan error, already recorded
+        }
+        ++profile.tokens;
 
-    text->lines[text->size++] = line;
+        Sentence s;
+        if (parser_feed(&parser, curr, &s))
+        {
+            ++profile.sentences;
+            symbol_scan_sentence(s);
+            compile_sentence(s, sd, st);
+            parser_recycle(&parser, s);
+        }
+    }
 
-    va_end(args);
-    va_end(argscopy);
+    if (diagnostics.size == 0)
+    {
+        if (st->spill == NULL)
+        {
+            // Lines already streamed to disk are out of the peephole's
+            // reach, so a spilled compile ships unbatched cleanups
+            peephole_text(st);
+        }
+        make(outfname, sd, st);
+    }
+    if (sd->spill != NULL)
+    {
+        fclose(sd->spill);
+    }
+    if (st->spill != NULL)
+    {
+        fclose(st->spill);
+    }
+
+    // The stages are fused here, so only the totals are meaningful
+    profile.total_wall = profile_wall() - total_start;
+    profile.total_cpu = profile_cpu() - cpu_start;
+    if (profile.enabled)
+    {
+        profile_report();
+    }
+
+    int status = diag_flush() ? -1 : 0;
+    intern_reset();
+    symbol_reset();
+    arena_reset();
+    release_source(source);
+    return status;
 }
 
-/* Inputs data retrieved from `Sentence` into provided `SectionData` and
- * `SectionText` pointers by generating ASM.
+/* Derives a batch-mode output name from an input name by stripping a
+ * trailing `.toki` extension ("dir/prog.toki" -> "dir/prog"). The caller
+ * frees the result.
  */
-void compile_sentence(Sentence s, SectionData *data, SectionText *text)
+static char *batch_output_name(const char *fname)
 {
-    if (s.subj.noun.type == TOKEN_NULL)
+    size_t len = strlen(fname);
+    const char *ext = ".toki";
+    size_t ext_len = strlen(ext);
+    if ((len > ext_len) && !strcmp(fname + len - ext_len, ext))
     {
-        // TODO: better error handling
-        if (s.pred.verb.type == TOKEN_NULL)
+        len -= ext_len;
+    }
+    char *out = malloc(len + 1);
+    memcpy(out, fname, len);
+    out[len] = '\0';
+    return out;
+}
+
+/* Batch mode: compiles every listed file in one process, so per-compile
+ * startup cost is paid once across a whole batch. Each input compiles to
+ * its own output (see `batch_output_name`). With `-j N` on POSIX systems
+ * the files are split round-robin across N forked workers; elsewhere (or
+ * with -j 1) they compile sequentially.
+ */
+int batch_main(int count, const char *files[])
+{
+    int workers = 1;
+    if ((count >= 2) && !strcmp(files[0], "-j"))
+    {
+        workers = atoi(files[1]);
+        if (workers < 1)
         {
-            fprintf(
-                stderr,
-                "Missing verb in sentence.\n");
-            exit(-1);
-            // else if (declarative) { error }
-            // could really be a nice succinct switch statement probably
+            workers = 1;
         }
-        else if (is_keyword((s.pred.verb), KEYWORD_SITELEN))
-        {
-            if (s.pred.obj.noun.type == TOKEN_IDENTIFIER)
-            {
-                // TODO: what about different types for different idents?
-                // Generate text
-                write_into_text(text, "push    dword VARIABLE_%s",
-                                (char *) s.pred.obj.noun.value);
-                write_into_text(text, "push    dword formatString");
-                write_into_text(text, "call    _printf");
-                write_into_text(text, "add     esp, byte 8");
-            }
-            else if (is_literal(s.pred.obj.noun, LITERAL_STRING))
-            {
-                // Generate data
-                write_into_data(data, "LITERAL_%d db \"%s\", 0",
-                                data->literals,
-                                (StringLiteralType) s.pred.obj.noun.value);
-
-                // Generate text
-                write_into_text(text, "push    dword LITERAL_%d",
-                                data->literals);
-                write_into_text(text, "push    dword formatString");
-                write_into_text(text, "call    _printf");
-                write_into_text(text, "add     esp, byte 8");
+        files += 2;
+        count -= 2;
+    }
 
-                ++data->literals;
-            }
-            else if (is_literal(s.pred.obj.noun, LITERAL_INTEGER))
-            {
-                write_into_text(text, "push    %d",
-                                * (IntegerLiteralType *) s.pred.obj.noun.value);
-                write_into_text(text, "push    dword formatInteger");
-                write_into_text(text, "call    _printf");
-                write_into_text(text, "add     esp, byte 8");
-            }
-            else if (is_literal(s.pred.obj.noun, LITERAL_FLOAT))
-            {
-                write_into_text(text, "push    %d",
-                                * (FloatLiteralType *) s.pred.obj.noun.value);
-                write_into_text(text, "push    dword formatFloat");
-                write_into_text(text, "call    _printf");
-                write_into_text(text, "add     esp, byte 8");
-            }
-            else
-            {
-                fprintf(
-                    stderr,
-                    "Incorrect object for verb 'sitelen'.\n");
-                exit(-1);
-            }
-        }
+    if (count == 0)
+    {
+        fprintf(
+            stderr,
+            "No input files given for --batch.\n");
+        return -1;
     }
-    else  // extant subject
+    if (workers > count)
     {
-        if (s.pred.verb.type == TOKEN_NULL)
-        {
-            return;  // Do nothing, we have an lone NP
-        }
-        else if (is_keyword(s.pred.verb, KEYWORD_KAMA))
+        workers = count;
+    }
+
+#ifndef _WIN32
+    if (workers > 1)
+    {
+        for (int w = 0; w < workers; ++w)
         {
-            if (s.subj.noun.type != TOKEN_IDENTIFIER)
+            pid_t pid = fork();
+            if (pid == 0)
             {
-                fprintf(
-                    stderr,
-                    "Subject must be identifier in assignment.\n");
-                exit(-1);
+                int failed = 0;
+                for (int i = w; i < count; i += workers)
+                {
+                    char *outfname = batch_output_name(files[i]);
+                    if (compile_file(files[i], outfname) != 0)
+                    {
+                        ++failed;
+                    }
+                    free(outfname);
+                }
+                _exit(failed ? 1 : 0);
             }
-            if (s.pred.obj.noun.type == TOKEN_NULL)
+            else if (pid < 0)
             {
                 fprintf(
                     stderr,
-                    "Assignment statement needs object.\n");
-                exit(-1);
+                    "Failed to fork batch worker.\n"
+                    "  %s",
+                    strerror(errno));
+                return -1;
             }
+        }
 
-            // Generate data
-            if (is_literal(s.pred.obj.noun, LITERAL_STRING))
-            {
-                write_into_data(
-                    data, "VARIABLE_%s db \"%s\", 0",
-                    (char *) s.subj.noun.value,
-                    (StringLiteralType) s.pred.obj.noun.value
-                    );
-            }
-            else if (is_literal(s.pred.obj.noun, LITERAL_INTEGER))
-            {
-                write_into_data(
-                    data, "VARIABLE_%s dq %d",
-                    (char *) s.subj.noun.value,
-                    * (IntegerLiteralType *) s.pred.obj.noun.value
-                    );
-            }
-            else if (is_literal(s.pred.obj.noun, LITERAL_FLOAT))
+        // Fail the batch if any worker failed
+        bool failed = false;
+        int status;
+        while (wait(&status) > 0)
+        {
+            if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
             {
-                write_into_data(
-                    data, "VARIABLE_%s dq %f",
-                    (char *) s.subj.noun.value,
-                    * (FloatLiteralType *) s.pred.obj.noun.value
-                    );
+                failed = true;
             }
         }
+        return failed ? -1 : 0;
+    }
+#endif
+
+    int failed = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        char *outfname = batch_output_name(files[i]);
+        if (compile_file(files[i], outfname) != 0)
+        {
+            ++failed;
+        }
+        free(outfname);
     }
+    return failed ? -1 : 0;
 }
 
-/* Writes data from `SectionData` and `SectionText` into an assembly file.
+/* Daemon mode: the compiler stays resident and serves compile requests
+ * over a Unix domain socket, so a build farm pays process startup once
+ * instead of once per file, and every request after the first runs with
+ * a warmed arena (see `arena_reset`). One request per connection, as a
+ * single line:
+ *     <input path> <output path>\n
+ * or the single word `stop` to shut the server down; the reply is `ok`
+ * once the compile has finished, or `error` if the source produced
+ * diagnostics (printed on the daemon's stderr). Requests are served
+ * sequentially in this process; a bad source fails its request without
+ * taking the server down.
  */
-void write(const char *outfile, const SectionData *sd, const SectionText *st)
+int daemon_main(const char *socket_path)
 {
-    char *fname = malloc(80 * sizeof(char));
-    strcpy(fname, outfile);
-    strcat(fname, ".asm");
-
-    FILE *fptr = fopen(fname, "w");
-
-    if (fptr == NULL)
+#ifdef _WIN32
+    fprintf(
+        stderr,
+        "--daemon requires Unix domain sockets.\n");
+    return -1;
+#else
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
     {
         fprintf(
             stderr,
-            "Failed to create ASM file.\n"
+            "Failed to create daemon socket.\n"
             "  %s",
             strerror(errno));
-
-        exit(-1);
+        return -1;
     }
 
-    // opening boilerplate
-    fprintf(fptr,
-            "    global _main\n"
-            "    extern _printf\n\n"
-            "section .text\n"
-            "    _main:\n");
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    unlink(socket_path);  // stale socket from a previous daemon
 
-    // _main:
-    for (int i = 0; i < st->size; ++i)
+    if ((bind(server, (struct sockaddr *) &addr, sizeof(addr)) < 0) ||
+        (listen(server, 16) < 0))
     {
-        fprintf(fptr, "        %s\n", st->lines[i]);
+        fprintf(
+            stderr,
+            "Failed to listen on %s.\n"
+            "  %s",
+            socket_path,
+            strerror(errno));
+        close(server);
+        return -1;
     }
 
-    // end .text boilerplate
-    fprintf(fptr,
-            "        ret\n\n");
+    for (;;)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
 
-    // .data boilerplate
-    fprintf(fptr,
-            "section .data\n"
-            "    formatString db \"%%s\", 10, 0\n"
-            "    formatInteger db \"%%d\", 10, 0\n"
-            "    formatFloat db \"%%f\", 10, 0\n");
+        // Read the request line
+        char line[512];
+        size_t length = 0;
+        while (length < sizeof(line) - 1)
+        {
+            ssize_t got = read(client, line + length,
+                               sizeof(line) - 1 - length);
+            if (got <= 0)
+            {
+                break;
+            }
+            length += (size_t) got;
+            if (memchr(line, '\n', length) != NULL)
+            {
+                break;
+            }
+        }
+        line[length] = '\0';
+        char *newline = strchr(line, '\n');
+        if (newline != NULL)
+        {
+            *newline = '\0';
+        }
 
-    // .data:
-    for (int i = 0; i < sd->size; ++i)
-    {
-        fprintf(fptr, "    %s\n", sd->lines[i]);
-    }
+        if (!strcmp(line, "stop"))
+        {
+            ssize_t ignored = write(client, "ok\n", 3);
+            (void) ignored;
+            close(client);
+            break;
+        }
 
-    fclose(fptr);
-}
+        char *outfname = strchr(line, ' ');
+        if (outfname == NULL)
+        {
+            ssize_t ignored = write(client, "bad request\n", 12);
+            (void) ignored;
+            close(client);
+            continue;
+        }
+        *outfname++ = '\0';
 
-/* Makes the assembly file into an `.exe`.
- */
-void make(const char *outfile)
-{
-    char *cmd1 = malloc(80 * sizeof(const char));
-    char *cmd2 = malloc(80 * sizeof(const char));
-    sprintf(cmd1, "nasm -f win32 %s.asm", outfile);
-    sprintf(cmd2, "gcc %s.obj -o %s", outfile, outfile);
-    system(cmd1);
-    system(cmd2);
-    free(cmd1);
-    free(cmd2);
+        const char *reply =
+            (compile_file(line, outfname) == 0) ? "ok\n" : "error\n";
+        ssize_t ignored = write(client, reply, strlen(reply));
+        (void) ignored;
+        close(client);
+    }
 
-#if DELETE_INTERMEDIATE
-    char *cmd3 = malloc(80 * sizeof(const char));
-    char *cmd4 = malloc(80 * sizeof(const char));
-    sprintf(cmd3, "del %s.asm", outfile);
-    sprintf(cmd4, "del %s.obj", outfile);
-    system(cmd3);
-    system(cmd4);
-    free(cmd3);
-    free(cmd4);
+    close(server);
+    unlink(socket_path);
+    return 0;
 #endif
 }
 
-/* Compiles every sentence, writes to an ASM file, and then makes the file.
- */
-void compile(const char *outfile, SentenceList input)
+int main(int argc, const char *argv[])
 {
+    const char *fname;
+    const char *outfname;
 
-    SectionData *sd = malloc(sizeof(SectionData));
-    sd->literals = 0;
-    SectionText *st = malloc(sizeof(SectionData));
-
-    sd->lines = malloc(100 * sizeof(const char *));
-    sd->size = 0;
-    st->lines = malloc(100 * sizeof(const char *));
-    st->size = 0;
-
-    // Convert SentenceList to SectionData and SectionText
-    for (int i = 0; i < input.size; ++i)
+    // --profile, --jobs and --linker compose with the mode flags below,
+    // so shift them off first
+    if ((argc >= 2) && !strcmp(argv[1], "--profile"))
     {
-        compile_sentence(input.list[i], sd, st);
+        profile.enabled = true;
+        --argc;
+        ++argv;
+    }
+    if ((argc >= 3) && !strcmp(argv[1], "--jobs"))
+    {
+        codegen_jobs = atoi(argv[2]);
+        if (codegen_jobs < 1)
+        {
+            codegen_jobs = 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if ((argc >= 3) && !strcmp(argv[1], "--linker"))
+    {
+        link_command = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    // Bounded-memory compile: stream sections to disk past the budget.
+    // Implies the pipelined path, which is the only one that does not
+    // hold the whole program in memory anyway.
+    if ((argc >= 3) && !strcmp(argv[1], "--budget"))
+    {
+        memory_budget = strtoull(argv[2], NULL, 10);
+        argc -= 2;
+        argv += 2;
     }
 
-    write(outfile, sd, st);
-    make(outfile);
-}
-
-
-// MAIN
+    if ((argc >= 2) && !strcmp(argv[1], "--batch"))
+    {
+        exit(batch_main(argc - 2, argv + 2));
+    }
 
-int main(int argc, const char *argv[])
-{
-    const char *fname;
-    const char *outfname;
+    // Resident compile server (see daemon_main)
+    if ((argc >= 2) && !strcmp(argv[1], "--daemon"))
+    {
+        exit(daemon_main((argc >= 3) ? argv[2] : DEFAULT_SOCKET_FILENAME));
+    }
 
+    // Single-pass mode: scan, parse and compile in lockstep
+    if (((argc >= 2) && !strcmp(argv[1], "--pipeline")) ||
+        (memory_budget != 0))
+    {
+        if ((argc >= 2) && !strcmp(argv[1], "--pipeline"))
+        {
+            --argc;
+            ++argv;
+        }
+        fname = (argc >= 2) ? argv[1] : DEFAULT_INPUT_FILENAME;
+        outfname = (argc >= 3) ? argv[2] : DEFAULT_OUTPUT_FILENAME;
+        exit(compile_file_pipelined(fname, outfname));
+    }
     // check number of arguments
     if (argc == 3)
     {
@@ -1111,48 +4170,7 @@ int main(int argc, const char *argv[])
         outfname = DEFAULT_OUTPUT_FILENAME;
     }
 
-    // open file
-    FILE *fptr = fopen(fname, "rb");
-
-    // check file existed
-    if (fptr == NULL)
-    {
-        fprintf(
-            stderr,
-            "File \"%s\" not found.\n"
-            "  %s",
-            fname, strerror(errno));
-
-        exit(-1);
-    }
-
-    // read file
-    // from Nils Pipenbrinck on stack overflow
-    fseek(fptr, 0, SEEK_END);
-    long length = ftell(fptr);
-    fseek(fptr, 0, SEEK_SET);
-    char *buffer = malloc((length + 1) * sizeof(char));
-    if (buffer)
-    {
-        fread(buffer, 1, length, fptr);
-        buffer[length] = '\0';
-    }
-
-    if (buffer == NULL)
-    {
-        fprintf(
-            stderr,
-            "Something went wrong reading file!"
-        );
-        exit(-1);
-    }
-
-    LexemeList lexemes = scan(buffer);
-    TokenList tokens = evaluate(lexemes);
-    SentenceList sentences = parse(tokens);
-    compile(outfname, sentences);
-
-    fclose(fptr);
-
-    exit(0);
+    exit(compile_file(fname, outfname));
 }
+
+#endif  // !TOKI_BENCH